@@ -2,28 +2,26 @@
     2012 Kaetemi https://blog.kaetemi.be
     2025 TAiGA   https://github.com/metarutaiga/miMAX
 */
+#include <math.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include <functional>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
 #include <tuple>
 
 #define __MIMAX_INTERNAL__
 #include "miMAX.h"
 
-#if _CPPUNWIND || __cpp_exceptions
-#include <exception>
-#define TRY         try {
-#define CATCH(x)    } catch(x)
-#define THROW       throw std::runtime_error(__FILE_NAME__ ":" _LIBCPP_TOSTRING(__LINE__))
-#else
-#include <setjmp.h>
-thread_local jmp_buf compoundfilereader_jmp_buf = {};
-#define TRY         if (setjmp(compoundfilereader_jmp_buf) == 0) {
-#define CATCH(x)    } else
-#define THROW       longjmp(compoundfilereader_jmp_buf, 1);
-#define throw       longjmp(compoundfilereader_jmp_buf, 1);
-#endif
-#include "compoundfilereader/src/include/compoundfilereader.h"
 #include "compoundfilereader/src/include/utf.h"
 
 #if defined(__APPLE__)
@@ -43,33 +41,193 @@ static std::string format(char const* format, Args&&... args)
     return output;
 }
 
-static std::vector<char> uncompress(std::vector<char> const& input)
+#ifndef MIMAX_PROFILE
+#define MIMAX_PROFILE                   1
+#endif
+
+#if MIMAX_PROFILE
+struct Profile
+{
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    std::mutex mutex;
+    std::vector<miMaxStats::Timer> timers;
+    std::atomic<uint32_t> threads = {};
+    uint64_t serial = nextSerial();
+    std::atomic<uint64_t> chunks = {};
+    std::atomic<uint64_t> links = {};
+    std::atomic<uint64_t> propertyBytes = {};
+    std::atomic<uint64_t> unknownClasses = {};
+
+    uint64_t now() const
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    static uint64_t nextSerial()
+    {
+        static std::atomic<uint64_t> serial = {};
+        return ++serial;
+    }
+};
+
+static thread_local Profile* profile = nullptr;
+
+// Threads are numbered in the order they first record a timer of a session
+static uint32_t profileThread()
+{
+    static thread_local uint64_t serial = 0;
+    static thread_local uint32_t thread = 0;
+    if (serial != profile->serial) {
+        serial = profile->serial;
+        thread = profile->threads++;
+    }
+    return thread;
+}
+
+struct ProfileTimer
+{
+    char const* name;
+    uint64_t begin = profile ? profile->now() : 0;
+
+    ~ProfileTimer()
+    {
+        stop();
+    }
+
+    void stop()
+    {
+        if (profile == nullptr || name == nullptr)
+            return;
+        uint64_t end = profile->now();
+        uint32_t thread = profileThread();
+        std::lock_guard<std::mutex> lock(profile->mutex);
+        profile->timers.push_back({ name, begin, end - begin, thread });
+        name = nullptr;
+    }
+};
+
+// Pool threads run work of several callers, so the session is restored after each task
+struct ProfileEnter
+{
+    Profile* previous;
+
+    ProfileEnter(Profile* caller) : previous(profile)
+    {
+        profile = caller;
+    }
+
+    ~ProfileEnter()
+    {
+        profile = previous;
+    }
+};
+
+#define PROFILE_TIMER(timer, name)      ProfileTimer timer = { name }
+#define PROFILE_STOP(timer)             timer.stop()
+#define PROFILE_COUNT(counter, value)   do { if (profile) profile->counter.fetch_add(value, std::memory_order_relaxed); } while (0)
+#define PROFILE_CAPTURE                 Profile* profileCaller = profile
+#define PROFILE_ENTER                   ProfileEnter profileEnter = { profileCaller }
+#else
+#define PROFILE_TIMER(timer, name)      (void)(name)
+#define PROFILE_STOP(timer)
+#define PROFILE_COUNT(counter, value)
+#define PROFILE_CAPTURE
+#define PROFILE_ENTER
+#endif
+
+struct Stream
+{
+    char const* data = nullptr;
+    size_t size = 0;
+    std::pmr::vector<char> storage;
+
+    explicit Stream(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) : storage(resource) {}
+};
+
+// Every thread allocates from its own monotonic arena while a file is open, so only the
+// first allocation of a thread takes the lock. Deallocation is a no-op, so memory may be
+// handed back from any thread and is released with the arenas.
+struct ScratchResource : public std::pmr::memory_resource
+{
+    std::pmr::memory_resource* upstream;
+    uint64_t id;
+    std::mutex mutex;
+    std::map<std::thread::id, std::pmr::monotonic_buffer_resource> arenas;
+
+    static std::atomic<uint64_t> generation;
+    static thread_local uint64_t cacheID;
+    static thread_local std::pmr::memory_resource* cacheArena;
+
+    explicit ScratchResource(std::pmr::memory_resource* upstream) : upstream(upstream), id(++generation) {}
+
+    std::pmr::memory_resource* local()
+    {
+        if (cacheID != id) {
+            std::lock_guard<std::mutex> lock(mutex);
+            cacheArena = &(*arenas.try_emplace(std::this_thread::get_id(), upstream).first).second;
+            cacheID = id;
+        }
+        return cacheArena;
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        return local()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void*, size_t, size_t) override
+    {
+    }
+
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+std::atomic<uint64_t> ScratchResource::generation = {};
+thread_local uint64_t ScratchResource::cacheID = 0;
+thread_local std::pmr::memory_resource* ScratchResource::cacheArena = nullptr;
+
+// Scratch of the open running on this thread
+static thread_local std::pmr::memory_resource* threadScratch = nullptr;
+
+// Temporaries of the decoders, from the heap outside an open
+static std::pmr::memory_resource* getScratch()
+{
+    return threadScratch ? threadScratch : std::pmr::get_default_resource();
+}
+
+static void uncompress([[maybe_unused]] Stream& stream)
 {
 #if defined(__APPLE__)
-    if (input.size() < 10 || input[0] != char(0x1F) || input[1] != char(0x8B))
-        return input;
+    if (stream.size < 10 || stream.data[0] != char(0x1F) || stream.data[1] != char(0x8B))
+        return;
 
-    z_stream stream = {};
-    stream.next_in = (Bytef*)input.data();
-    stream.avail_in = (uInt)input.size();
-    inflateInit2(&stream, MAX_WBITS | 32);
+    z_stream z = {};
+    z.next_in = (Bytef*)stream.data;
+    z.avail_in = (uInt)stream.size;
+    inflateInit2(&z, MAX_WBITS | 32);
 
-    std::vector<char> output(input.size());
-    stream.next_out = (Bytef*)output.data();
-    stream.avail_out = (uint)output.size();
+    std::pmr::vector<char> output(stream.size, stream.storage.get_allocator());
+    z.next_out = (Bytef*)output.data();
+    z.avail_out = (uint)output.size();
     for (;;) {
-        int result = inflate(&stream, Z_NO_FLUSH);
+        int result = inflate(&z, Z_NO_FLUSH);
         if (result == Z_BUF_ERROR) {
             output.push_back(0);
             output.resize(output.capacity());
-            stream.next_out = (Bytef*)(output.data() + stream.total_out);
-            stream.avail_out = (uint)(output.size() - stream.total_out);
+            z.next_out = (Bytef*)(output.data() + z.total_out);
+            z.avail_out = (uint)(output.size() - z.total_out);
             continue;
         }
         if (result == Z_STREAM_END) {
-            output.resize(stream.total_out);
-            inflateEnd(&stream);
-            return output;
+            output.resize(z.total_out);
+            inflateEnd(&z);
+            stream.storage = std::move(output);
+            stream.data = stream.storage.data();
+            stream.size = stream.storage.size();
+            return;
         }
         if (result == Z_OK) {
             continue;
@@ -77,10 +235,7 @@ static std::vector<char> uncompress(std::vector<char> const& input)
         break;
     }
 
-    inflateEnd(&stream);
-    return input;
-#else
-    return input;
+    inflateEnd(&z);
 #endif
 }
 
@@ -89,7 +244,26 @@ static constexpr uint64_t class64(ClassID classID)
     return (uint64_t)classID.first | ((uint64_t)classID.second << 32);
 }
 
-static void parseStream(Chunk& chunk, char const* begin, char const* end)
+static uint64_t hash64(void const* data, size_t size, uint64_t seed)
+{
+    uint64_t hash = seed ^ (size * 0x9E3779B97F4A7C15ull);
+    char const* pointer = (char const*)data;
+    for (; size; ) {
+        uint64_t value = 0;
+        size_t count = std::min<size_t>(size, sizeof(uint64_t));
+        memcpy(&value, pointer, count);
+        pointer += count;
+        size -= count;
+        hash ^= value * 0xBF58476D1CE4E5B9ull;
+        hash = ((hash << 31) | (hash >> 33)) * 0x94D049BB133111EBull;
+    }
+    hash ^= hash >> 29;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static void parseStream(Chunk& chunk, char const* base, char const* begin, char const* end)
 {
     bool children = false;
     uint16_t type = 0;
@@ -119,18 +293,29 @@ static void parseStream(Chunk& chunk, char const* begin, char const* end)
         char const* next = (header + length);
         if (next > end)
             break;
-        Chunk child;
+        Chunk child(chunk.get_allocator());
         child.type = type;
-        child.name = format("%04X", type);
+        child.offset = header - base;
+        child.length = length;
         if (children) {
-            parseStream(child, begin, next);
+            parseStream(child, base, begin, next);
         }
         else {
             child.property.assign(begin, next);
+            child.hash = hash64(child.property.data(), child.property.size(), type);
         }
         chunk.emplace_back(std::move(child));
         begin = next;
     }
+
+    PROFILE_COUNT(chunks, chunk.size());
+
+    // Merkle hash over the children
+    uint64_t hash = hash64(nullptr, 0, chunk.type | 0x10000ull);
+    for (auto& child : chunk) {
+        hash = hash64(&child.hash, sizeof(uint64_t), hash);
+    }
+    chunk.hash = hash;
 }
 
 template <typename... Args>
@@ -157,43 +342,48 @@ static std::vector<T> getProperty(Chunk const& chunk, Args&&... args)
             continue;
         T* data = (T*)found->property.data();
         size_t size = found->property.size() / sizeof(T);
+        PROFILE_COUNT(propertyBytes, size * sizeof(T));
         return std::vector<T>(data, data + size);
     }
     return std::vector<T>();
 }
 
-static std::tuple<std::string, ClassData> getClass(Chunk const& classDirectory, uint16_t classIndex)
+static void getClassDirectory(Chunk const& classDirectory, std::vector<miMaxNode::Class>& classes)
 {
-    if (classDirectory.size() <= classIndex)
-        return {};
-    auto& chunk = classDirectory[classIndex];
-    auto propertyClassName = getProperty<uint16_t>(chunk, 0x2042);
-    auto propertyClassChunk = getProperty<ClassData>(chunk, 0x2060);
-    if (propertyClassChunk.empty())
-        return {};
-    if (propertyClassName.empty())
-        return { "(Unnamed)", *propertyClassChunk.data() };
-    return { UTF16ToUTF8(propertyClassName.data(), propertyClassName.size()), *propertyClassChunk.data() };
+    classes.resize(classDirectory.size());
+    for (size_t i = 0; i < classDirectory.size(); ++i) {
+        auto& chunk = classDirectory[i];
+        auto propertyClassName = getProperty<uint16_t>(chunk, 0x2042);
+        auto propertyClassData = getProperty<ClassData>(chunk, 0x2060);
+        if (propertyClassData.empty())
+            continue;
+        auto& output = classes[i];
+        output.classData = propertyClassData.front();
+        if (propertyClassName.empty())
+            output.name = "(Unnamed)";
+        else
+            output.name = UTF16ToUTF8(propertyClassName.data(), propertyClassName.size());
+    }
 }
 
-static std::tuple<std::string, std::string> getDll(Chunk const& dllDirectory, uint32_t dllIndex)
+static void getDllDirectory(Chunk const& dllDirectory, std::vector<miMaxNode::Dll>& dlls)
 {
-    if (dllIndex == UINT32_MAX)
-        return { "(Internal)", "(Internal)" };
-    if (dllDirectory.size() <= dllIndex)
-        return { "(Unknown)", "(Unknown)" };
-    auto& chunk = dllDirectory[dllIndex];
-    auto propertyDllFile = getProperty<uint16_t>(chunk, 0x2037);
-    auto propertyDllName = getProperty<uint16_t>(chunk, 0x2039);
-    if (propertyDllFile.empty() || propertyDllName.empty())
-        return { "(Unknown)", "(Unknown)" };
-    return { UTF16ToUTF8(propertyDllFile.data(), propertyDllFile.size()), UTF16ToUTF8(propertyDllName.data(), propertyDllName.size()) };
+    dlls.resize(dllDirectory.size(), { "(Unknown)", "(Unknown)" });
+    for (size_t i = 0; i < dllDirectory.size(); ++i) {
+        auto& chunk = dllDirectory[i];
+        auto propertyDllFile = getProperty<uint16_t>(chunk, 0x2037);
+        auto propertyDllName = getProperty<uint16_t>(chunk, 0x2039);
+        if (propertyDllFile.empty() || propertyDllName.empty())
+            continue;
+        dlls[i] = { UTF16ToUTF8(propertyDllFile.data(), propertyDllFile.size()), UTF16ToUTF8(propertyDllName.data(), propertyDllName.size()) };
+    }
 }
 
 template <class order = std::less<uint32_t>>
-static std::map<uint32_t, uint32_t, order> getLink(Chunk const& chunk)
+static std::pmr::map<uint32_t, uint32_t, order> getLink(Chunk const& chunk, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
 {
-    std::map<uint32_t, uint32_t, order> link;
+    std::pmr::map<uint32_t, uint32_t, order> link(resource);
+    PROFILE_COUNT(links, 1);
     auto propertyLink2034 = getProperty<uint32_t>(chunk, 0x2034);
     auto propertyLink2035 = getProperty<uint32_t>(chunk, 0x2035);
     for (uint32_t i = 0; i < propertyLink2034.size(); ++i)
@@ -206,8 +396,11 @@ static std::map<uint32_t, uint32_t, order> getLink(Chunk const& chunk)
 template <typename... Args>
 static Chunk const* getLinkChunk(Chunk const& scene, Chunk const& chunk, Args&&... args)
 {
+    // Link maps are short-lived, so they are kept on the stack
+    char buffer[1024];
+    std::pmr::monotonic_buffer_resource scratch(buffer, sizeof(buffer));
     auto* output = &chunk;
-    auto link = getLink(*output);
+    auto link = getLink(*output, &scratch);
     for (uint32_t index : { args... }) {
         auto it = link.find(index);
         if (it == link.end())
@@ -216,20 +409,11 @@ static Chunk const* getLinkChunk(Chunk const& scene, Chunk const& chunk, Args&&.
             return nullptr;
         auto& chunk = scene[(*it).second];
         output = &chunk;
-        link = getLink(*output);
+        link = getLink(*output, &scratch);
     }
     return output;
 }
 
-static bool checkClass(int(*log)(char const*, ...), Chunk const& chunk, ClassID classID, SuperClassID superClassID)
-{
-    if (chunk.classData.classID == classID && chunk.classData.superClassID == superClassID)
-        return true;
-    auto& classData = chunk.classData;
-    log("Unknown (%08X-%08X-%08X-%08X) %s", classData.dllIndex, classData.classID.first, classData.classID.second, classData.superClassID, chunk.name.c_str());
-    return false;
-}
-
 static void eulerToQuaternion(float quaternion[4], float euler[3])
 {
     float cx = cosf(euler[0] * 0.5f);
@@ -244,29 +428,163 @@ static void eulerToQuaternion(float quaternion[4], float euler[3])
     quaternion[3] = (cx * cy * cz + sx * sy * sz);
 }
 
-static std::vector<std::tuple<float, int, Point3>> getParamBlock(Chunk const& paramBlock)
+struct Param
+{
+    uint32_t type = UINT32_MAX;
+    uint32_t size = 0;
+    char const* data = nullptr;
+
+    // Tab arrays start with their element count
+    bool tab() const
+    {
+        return type != UINT32_MAX && (type & TYPE_TAB);
+    }
+
+    template <typename T>
+    T get(size_t index = 0) const
+    {
+        T value = {};
+        size_t offset = (tab() ? sizeof(uint32_t) : 0) + index * sizeof(T);
+        if (data && offset < size)
+            memcpy(&value, data + offset, std::min(sizeof(T), size - offset));
+        return value;
+    }
+
+    template <typename T>
+    size_t count() const
+    {
+        if (tab() == false)
+            return size / sizeof(T);
+        uint32_t count = 0;
+        if (data && size >= sizeof(uint32_t))
+            memcpy(&count, data, sizeof(uint32_t));
+        return std::min<size_t>(count, (size - std::min<size_t>(size, sizeof(uint32_t))) / sizeof(T));
+    }
+
+    // TYPE_STRING and TYPE_FILENAME are UTF-16
+    std::string string() const
+    {
+        std::vector<uint16_t> text(count<uint16_t>());
+        for (size_t i = 0; i < text.size(); ++i) {
+            text[i] = get<uint16_t>(i);
+        }
+        while (text.empty() == false && text.back() == 0)
+            text.pop_back();
+        return UTF16ToUTF8(text.data(), text.size());
+    }
+
+    // TYPE_INODE, TYPE_MTL, TYPE_TEXMAP and TYPE_REFTARG hold a reference index of the parameter block
+    uint32_t reference(size_t index = 0) const
+    {
+        return get<uint32_t>(index);
+    }
+};
+
+struct ParamBlock : public std::pmr::vector<Param>
+{
+    using std::pmr::vector<Param>::vector;
+};
+
+// Messages of one task, locked on their own so tasks never share a lock
+struct LogBuffer
+{
+    std::string text;
+    std::mutex mutex;
+};
+
+static thread_local LogBuffer* logBuffer = nullptr;
+
+struct Log
+{
+    miMaxReader* reader = nullptr;
+    std::mutex* mutex = nullptr;
+
+    template <typename... Args>
+    void operator()(char const* text, Args&&... args) const
+    {
+        std::string message = format(text, args...);
+        if (logBuffer) {
+            std::lock_guard<std::mutex> lock(logBuffer->mutex);
+            logBuffer->text.append(message);
+            logBuffer->text.push_back('\n');
+            return;
+        }
+        if (reader == nullptr)
+            return;
+        std::unique_lock<std::mutex> lock;
+        if (mutex)
+            lock = std::unique_lock<std::mutex>(*mutex);
+        if (reader->log)
+            reader->log("%s", message.c_str());
+        reader->diagnostics.emplace_back(std::move(message));
+    }
+};
+
+struct Context
+{
+    Log log;
+    Chunk const& scene;
+    std::vector<miMaxNode::Class> const& classes;
+    std::pmr::vector<ParamBlock> paramBlocks;
+    std::vector<std::shared_ptr<miMaxMesh const>> meshes;
+    std::vector<uint32_t> parents;
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource();
+    bool compact = false;
+    int patchSteps = 5;
+    float splineFlatness = 0.01f;
+};
+
+static ClassData const& getClassData(Context const& context, Chunk const& chunk)
+{
+    static ClassData const empty = {};
+    if (context.classes.size() <= chunk.classIndex)
+        return empty;
+    return context.classes[chunk.classIndex].classData;
+}
+
+static std::string getClassName(Context const& context, Chunk const& chunk)
+{
+    if (context.classes.size() <= chunk.classIndex)
+        return format("%04X", chunk.type);
+    return context.classes[chunk.classIndex].name;
+}
+
+static bool checkClass(Context const& context, Chunk const& chunk, ClassID classID, SuperClassID superClassID)
+{
+    auto& classData = getClassData(context, chunk);
+    if (classData.classID == classID && classData.superClassID == superClassID)
+        return true;
+    PROFILE_COUNT(unknownClasses, 1);
+    context.log("Unknown (%08X-%08X-%08X-%08X) %s", classData.dllIndex, classData.classID.first, classData.classID.second, classData.superClassID, getClassName(context, chunk).c_str());
+    return false;
+}
+
+static void decodeParamBlock(Context const& context, Chunk const& paramBlock, ParamBlock& output)
 {
-    std::vector<std::tuple<float, int, Point3>> output;
-    switch (paramBlock.classData.superClassID) {
+    switch (getClassData(context, paramBlock).superClassID) {
     case PARAMETER_BLOCK_SUPERCLASS_ID: {
-        auto propertyCount = getProperty<int>(paramBlock, 0x0001);
-        unsigned int count = propertyCount.empty() ? propertyCount.front() : 0;
+        auto* chunkCount = getChunk(paramBlock, 0x0001);
+        uint32_t count = 0;
+        if (chunkCount && chunkCount->property.size() >= sizeof(uint32_t))
+            memcpy(&count, chunkCount->property.data(), sizeof(uint32_t));
+        output.reserve(count);
         for (auto& chunk : paramBlock) {
             if (output.size() >= count)
                 break;
-            if (chunk.type == 0x0002) {
-                auto propertyFloat = getProperty<float>(chunk, 0x0100);
-                auto propertyInt = getProperty<int>(chunk, 0x0101);
-                auto propertyRGBA = getProperty<Point3>(chunk, 0x0102);
-                auto propertyPoint3 = getProperty<Point3>(chunk, 0x0103);
-                auto propertyBool = getProperty<bool>(chunk, 0x0104);
-                output.push_back({});
-                auto& [f, i, p] = output.back();
-                if (propertyFloat.empty() == false)     f = propertyFloat.front();
-                if (propertyInt.empty() == false)       i = propertyInt.front();
-                if (propertyRGBA.empty() == false)      p = propertyRGBA.front();
-                if (propertyPoint3.empty() == false)    p = propertyPoint3.front();
-                if (propertyBool.empty() == false)      i = propertyBool.front();
+            if (chunk.type != 0x0002)
+                continue;
+            auto& param = output.emplace_back();
+            for (auto& value : chunk) {
+                switch (value.type) {
+                case 0x0100: param.type = TYPE_FLOAT;   break;
+                case 0x0101: param.type = TYPE_INT;     break;
+                case 0x0102: param.type = TYPE_RGBA;    break;
+                case 0x0103: param.type = TYPE_POINT3;  break;
+                case 0x0104: param.type = TYPE_BOOL;    break;
+                default:     continue;
+                }
+                param.size = uint32_t(value.property.size());
+                param.data = value.property.data();
             }
         }
         break;
@@ -278,92 +596,95 @@ static std::vector<std::tuple<float, int, Point3>> getParamBlock(Chunk const& pa
             if (chunk.type != 0x000E && chunk.type != 0x100E)
                 continue;
             uint16_t index = 0;
-            uint32_t type = 0;
             memcpy(&index, chunk.property.data() + 0, sizeof(uint16_t));
-            memcpy(&type, chunk.property.data() + 2, sizeof(uint32_t));
             if (output.size() <= index)
                 output.resize(index + 1);
-            auto& [f, i, p] = output[index];
-            switch (type) {
-            case 0: // TYPE_FLOAT
-            case 5: // TYPE_ANGLE
-            case 6: // TYPE_PCNT_FRAC
-            case 7: // TYPE_WORLD
-                memcpy(&f, chunk.property.data() + 15, sizeof(float));
-                break;
-            case 1: // TYPE_INT
-            case 4: // TYPE_BOOL
-                memcpy(&i, chunk.property.data() + 15, sizeof(int));
-                break;
-            case 2: // TYPE_RGBA
-            case 3: // TYPE_POINT3
-                memcpy(&p, chunk.property.data() + 15, sizeof(Point3));
-                break;
-            }
+            auto& param = output[index];
+            memcpy(&param.type, chunk.property.data() + 2, sizeof(uint32_t));
+            param.size = uint32_t(chunk.property.size() - 15);
+            param.data = chunk.property.data() + 15;
         }
         break;
     default:
         break;
     }
-    return output;
 }
 
-static void getPositionRotationScale(int(*log)(char const*, ...), Chunk const& scene, Chunk const& chunk, miMaxNode& node)
+static ParamBlock const& getParamBlock(Context const& context, Chunk const& paramBlock)
 {
-    // FFFFFFFF-00002005-00000000-00009008 Position/Rotation/Scale  PRS_CONTROL_CLASS_ID + MATRIX3_SUPERCLASS_ID
-    if (checkClass(log, chunk, PRS_CONTROL_CLASS_ID, MATRIX3_SUPERCLASS_ID) == false)
-        return;
+    // Every block is decoded before the node pass, so the cache is only read here
+    static ParamBlock const empty;
+    size_t index = &paramBlock - context.scene.data();
+    if (index >= context.paramBlocks.size())
+        return empty;
+    return context.paramBlocks[index];
+}
 
-    // ????????-00002007-00000000-00009003 Bezier Float     HYBRIDINTERP_FLOAT_CLASS_ID + FLOAT_SUPERCLASS_ID
+static Chunk const* getParamReference(Context const& context, Chunk const& paramBlock, Param const& param, size_t index = 0)
+{
+    return getLinkChunk(context.scene, paramBlock, param.reference(index));
+}
 
+static bool getPosition(Context const& context, Chunk const& chunk, Point3& position)
+{
+    auto& scene = context.scene;
     // FFFFFFFF-00002002-00000000-0000900B Linear Position  LININTERP_POSITION_CLASS_ID + POSITION_SUPERCLASS_ID
     // ????????-00002008-00000000-0000900B Bezier Position  HYBRIDINTERP_POSITION_CLASS_ID + POSITION_SUPERCLASS_ID
     // ????????-118F7E02-FFEE238A-0000900B Position XYZ     IPOS_CONTROL_CLASS_ID + POSITION_SUPERCLASS_ID
     // FFFFFFFF-00442312-00000000-0000900B TCB Position     TCBINTERP_POSITION_CLASS_ID + POSITION_SUPERCLASS_ID
-    for (uint32_t i = 0; i < 1; ++i) {
-        auto* position = getLinkChunk(scene, chunk, 0);
-        if (position == nullptr)
-            continue;
-        auto& classData = position->classData;
-        switch (class64(classData.classID) | (classData.superClassID == POSITION_SUPERCLASS_ID ? 0 : -1)) {
-        case class64(IPOS_CONTROL_CLASS_ID):
-            for (uint32_t i = 0; i < 3; ++i) {
-                auto* array = getLinkChunk(scene, *position, i);
-                if (array == nullptr)
-                    continue;
-                if (checkClass(log, *array, HYBRIDINTERP_FLOAT_CLASS_ID, FLOAT_SUPERCLASS_ID) == false)
-                    continue;
-                auto* chunk7127 = getChunk(*array, 0x7127);
-                if (chunk7127)
-                    array = chunk7127;
-                auto propertyFloat = getProperty<float>(*array, FLOAT_TYPE);
-                if (propertyFloat.size() >= 1) {
-                    node.position[i] = propertyFloat[0];
-                    continue;
-                }
-                log("Value is not found (%s)", array->name.c_str());
-            }
-            continue;
-        case class64(LININTERP_POSITION_CLASS_ID):
-        case class64(HYBRIDINTERP_POSITION_CLASS_ID):
-        case class64(TCBINTERP_POSITION_CLASS_ID): {
-            auto* chunk7127 = getChunk(*position, 0x7127);
+    auto& classData = getClassData(context, chunk);
+    switch (class64(classData.classID) | (classData.superClassID == POSITION_SUPERCLASS_ID ? 0 : -1)) {
+    case class64(IPOS_CONTROL_CLASS_ID):
+        for (uint32_t i = 0; i < 3; ++i) {
+            auto* array = getLinkChunk(scene, chunk, i);
+            if (array == nullptr)
+                continue;
+            if (checkClass(context, *array, HYBRIDINTERP_FLOAT_CLASS_ID, FLOAT_SUPERCLASS_ID) == false)
+                continue;
+            auto* chunk7127 = getChunk(*array, 0x7127);
             if (chunk7127)
-                position = chunk7127;
-            auto propertyFloat = getProperty<float>(*position, FLOAT_TYPE);
-            if (propertyFloat.size() >= 3) {
-                node.position[0] = propertyFloat[0];
-                node.position[1] = propertyFloat[1];
-                node.position[2] = propertyFloat[2];
+                array = chunk7127;
+            auto propertyFloat = getProperty<float>(*array, FLOAT_TYPE);
+            if (propertyFloat.size() >= 1) {
+                position[i] = propertyFloat[0];
                 continue;
             }
-            log("Value is not found (%s)", position->name.c_str());
-            continue;
+            context.log("Value is not found (%s)", getClassName(context, *array).c_str());
         }
-        default:
-            break;
+        return true;
+    case class64(LININTERP_POSITION_CLASS_ID):
+    case class64(HYBRIDINTERP_POSITION_CLASS_ID):
+    case class64(TCBINTERP_POSITION_CLASS_ID): {
+        auto* value = getChunk(chunk, 0x7127);
+        if (value == nullptr)
+            value = &chunk;
+        auto propertyFloat = getProperty<float>(*value, FLOAT_TYPE);
+        if (propertyFloat.size() >= 3) {
+            position[0] = propertyFloat[0];
+            position[1] = propertyFloat[1];
+            position[2] = propertyFloat[2];
+            return true;
         }
-        checkClass(log, *position, {}, 0);
+        context.log("Value is not found (%s)", getClassName(context, *value).c_str());
+        return true;
+    }
+    default:
+        break;
+    }
+    return false;
+}
+
+static void getPositionRotationScale(Context const& context, Chunk const& chunk, miMaxNode& node)
+{
+    auto& scene = context.scene;
+    // FFFFFFFF-00002005-00000000-00009008 Position/Rotation/Scale  PRS_CONTROL_CLASS_ID + MATRIX3_SUPERCLASS_ID
+    if (checkClass(context, chunk, PRS_CONTROL_CLASS_ID, MATRIX3_SUPERCLASS_ID) == false)
+        return;
+
+    // ????????-00002007-00000000-00009003 Bezier Float     HYBRIDINTERP_FLOAT_CLASS_ID + FLOAT_SUPERCLASS_ID
+    auto* position = getLinkChunk(scene, chunk, 0);
+    if (position && getPosition(context, *position, node.position) == false) {
+        checkClass(context, *position, {}, 0);
     }
 
     // FFFFFFFF-00002003-00000000-0000900C Linear Rotation  LININTERP_ROTATION_CLASS_ID + ROTATION_SUPERCLASS_ID
@@ -373,14 +694,14 @@ static void getPositionRotationScale(int(*log)(char const*, ...), Chunk const& s
         auto* rotation = getLinkChunk(scene, chunk, 1);
         if (rotation == nullptr)
             continue;
-        auto& classData = rotation->classData;
+        auto& classData = getClassData(context, *rotation);
         switch (class64(classData.classID) | (classData.superClassID == ROTATION_SUPERCLASS_ID ? 0 : -1)) {
         case class64(HYBRIDINTERP_POINT4_CLASS_ID):
             for (uint32_t i = 0; i < 3; ++i) {
                 auto* array = getLinkChunk(scene, *rotation, i);
                 if (array == nullptr)
                     continue;
-                if (checkClass(log, *array, HYBRIDINTERP_FLOAT_CLASS_ID, FLOAT_SUPERCLASS_ID) == false)
+                if (checkClass(context, *array, HYBRIDINTERP_FLOAT_CLASS_ID, FLOAT_SUPERCLASS_ID) == false)
                     continue;
                 auto* chunk7127 = getChunk(*array, 0x7127);
                 if (chunk7127)
@@ -390,7 +711,7 @@ static void getPositionRotationScale(int(*log)(char const*, ...), Chunk const& s
                     node.rotation[i] = propertyFloat[0];
                     continue;
                 }
-                log("Value is not found (%s)", array->name.c_str());
+                context.log("Value is not found (%s)", getClassName(context, *array).c_str());
             }
             eulerToQuaternion(node.rotation.data(), node.rotation.data());
             continue;
@@ -411,13 +732,13 @@ static void getPositionRotationScale(int(*log)(char const*, ...), Chunk const& s
                 eulerToQuaternion(node.rotation.data(), propertyFloat.data());
                 continue;
             }
-            log("Value is not found (%s)", rotation->name.c_str());
+            context.log("Value is not found (%s)", getClassName(context, *rotation).c_str());
             continue;
         }
         default:
             break;
         }
-        checkClass(log, *rotation, {}, 0);
+        checkClass(context, *rotation, {}, 0);
     }
 
     // FFFFFFFF-00002004-00000000-0000900D Linear Scale LININTERP_SCALE_CLASS_ID + SCALE_SUPERCLASS_ID
@@ -427,7 +748,7 @@ static void getPositionRotationScale(int(*log)(char const*, ...), Chunk const& s
         auto* scale = getLinkChunk(scene, chunk, 2);
         if (scale == nullptr)
             continue;
-        auto& classData = scale->classData;
+        auto& classData = getClassData(context, *scale);
         switch (class64(classData.classID) | (classData.superClassID == SCALE_SUPERCLASS_ID ? 0 : -1)) {
         case class64(LININTERP_SCALE_CLASS_ID):
         case class64(HYBRIDINTERP_SCALE_CLASS_ID):
@@ -446,130 +767,2376 @@ static void getPositionRotationScale(int(*log)(char const*, ...), Chunk const& s
                 node.scale[0] = node.scale[1] = node.scale[2] = propertyFloat[0];
                 continue;
             }
-            log("Value is not found (%s)", scale->name.c_str());
+            context.log("Value is not found (%s)", getClassName(context, *scale).c_str());
             continue;
         }
         default:
             break;
         }
-        checkClass(log, *scale, {}, 0);
+        checkClass(context, *scale, {}, 0);
     }
 }
 
-static void getObjectSpaceModifier(int(*log)(char const*, ...), Chunk const& scene, Chunk const& chunk, Chunk const& modifierChunk, miMaxNode& node)
+static void decodeChannel(miMaxMesh const& mesh, miMaxMesh::ChannelSource const& source, miMaxMesh::Channel& channel)
 {
-    if (chunk.classData.superClassID != OSM_SUPERCLASS_ID)
-        return;
-    auto* pParamBlock = getLinkChunk(scene, chunk, 0);
-    if (pParamBlock == nullptr)
-        return;
-    auto paramBlock = getParamBlock(*pParamBlock);
+    // Vertex : count, { u, v, w } * count
+    size_t vertexCount = source.vertex.size() / sizeof(float);
+    if (vertexCount > 0) {
+        channel.u.reserve(vertexCount / 3);
+        channel.v.reserve(vertexCount / 3);
+        channel.w.reserve(vertexCount / 3);
+    }
+    for (size_t i = 1; i + 2 < vertexCount; i += 3) {
+        float uvw[3];
+        memcpy(uvw, source.vertex.data() + i * sizeof(float), sizeof(uvw));
+        channel.u.push_back(uvw[0]);
+        channel.v.push_back(uvw[1]);
+        channel.w.push_back(uvw[2]);
+    }
 
-    // ????????-4AA52AE3-35CA1CDE-00000810  EDIT_NORMALS_CLASS_ID + OSM_SUPERCLASS_ID
-    // ????????-7EBB4645-7BE2044B-00000810  PAINTLAYERMOD_CLASS_ID + OSM_SUPERCLASS_ID
-    switch (class64(chunk.classData.classID)) {
-    case class64(EDIT_NORMALS_CLASS_ID): {
-        auto* pNormalChunk = getChunk(modifierChunk, 0x2512, 0x0240);
-        if (pNormalChunk == nullptr)
-            pNormalChunk = getChunk(modifierChunk, 0x2512, 0x0250);
-        if (pNormalChunk == nullptr)
-            break;
-        auto normals = getProperty<float>(*pNormalChunk, 0x0110);
-        if (normals.empty())
-            break;
-        for (size_t i = 1; i + 2 < normals.size(); i += 3) {
-            node.normal.push_back({normals[i], normals[i + 1], normals[1 + 2]});
+    // Faces are stored in file order, but the mesh may be sorted by material
+    std::pmr::vector<uint32_t> faceStart;
+    auto* faceOffset = &mesh.faceOffset;
+    if (mesh.faceOrder.empty() == false) {
+        size_t faceCount = mesh.faceOrder.size();
+        std::vector<uint32_t> faceSize(faceCount);
+        for (size_t i = 0; i < faceCount; ++i) {
+            faceSize[mesh.faceOrder[i]] = mesh.faceOffset[i + 1] - mesh.faceOffset[i];
         }
-        node.text += format("Normal : %zd", node.normal.size()) + '\n';
-        break;
+        faceStart.resize(faceCount + 1);
+        for (size_t i = 0; i < faceCount; ++i) {
+            faceStart[i + 1] = faceStart[i] + faceSize[i];
+        }
+        faceOffset = &faceStart;
     }
-    case class64(PAINTLAYERMOD_CLASS_ID):
-        if (paramBlock.size() > 1) {
-            auto* pColorChunk = getChunk(modifierChunk, 0x2512);
-            if (pColorChunk == nullptr)
-                break;
-            switch (std::get<int>(paramBlock[1])) {
-            default:
-                node.vertexColor = getProperty<Point3>(*pColorChunk, 0x0110);
-                node.text += format("Vertex Color : %zd", node.vertexColor.size()) + '\n';
-                break;
-            case -1:
-                node.vertexIllum = getProperty<Point3>(*pColorChunk, 0x0110);
-                node.text += format("Vertex Illum : %zd", node.vertexIllum.size()) + '\n';
+
+    std::vector<uint32_t> face(source.face.size() / sizeof(uint32_t));
+    if (face.empty() == false)
+        memcpy(face.data(), source.face.data(), face.size() * sizeof(uint32_t));
+    channel.index.reserve(mesh.vertexArray.size());
+    if (source.polygon) {
+        // Face : { count, index * count } * faceCount
+        size_t faceIndex = 0;
+        for (size_t i = 0; i < face.size(); ++i) {
+            uint32_t count = face[i];
+            if (i + 1 + count > face.size() || faceIndex + 1 >= faceOffset->size())
                 break;
-            case -2:
-                node.vertexAlpha = getProperty<Point3>(*pColorChunk, 0x0110);
-                node.text += format("Vertex Alpha : %zd", node.vertexAlpha.size()) + '\n';
+            if ((*faceOffset)[faceIndex + 1] - (*faceOffset)[faceIndex] != count)
                 break;
-            }
+            channel.index.insert(channel.index.end(), face.begin() + i + 1, face.begin() + i + 1 + count);
+            faceIndex += 1;
+            i += count;
+        }
+    }
+    else {
+        // Face : count, { a, b, c } * count
+        for (size_t i = 1; i + 2 < face.size(); i += 3) {
+            channel.index.insert(channel.index.end(), face.begin() + i, face.begin() + i + 3);
         }
-        break;
-    default:
-        break;
+    }
+    bool inside = std::all_of(channel.index.begin(), channel.index.end(), [&](uint32_t index) {
+        return index < channel.u.size();
+    });
+    if (channel.index.size() != mesh.vertexArray.size() || inside == false) {
+        channel.index.clear();
+        return;
+    }
+    if (mesh.faceOrder.empty() == false) {
+        std::pmr::vector<uint32_t> index(channel.index.size(), channel.index.get_allocator());
+        for (size_t i = 0; i < mesh.faceOrder.size(); ++i) {
+            uint32_t begin = (*faceOffset)[mesh.faceOrder[i]];
+            uint32_t end = (*faceOffset)[mesh.faceOrder[i] + 1];
+            std::copy(channel.index.begin() + begin, channel.index.begin() + end, index.begin() + mesh.faceOffset[i]);
+        }
+        channel.index = std::move(index);
     }
 }
 
-static void getPrimitive(int(*log)(char const*, ...), Chunk const& scene, Chunk const& chunk, miMaxNode& node)
+miMaxMesh::Channel const* miMaxMesh::getChannel(int index) const
 {
-    auto* pChunk = &chunk;
-    if ((*pChunk).classData.superClassID != GEOMOBJECT_SUPERCLASS_ID) {
-        if ((*pChunk).type != 0x2032)
-            return;
-        auto link = getLink<std::greater<uint32_t>>(*pChunk);
-        for (auto [linkIndex, chunkIndex] : link) {
-            if (scene.size() <= chunkIndex)
-                continue;
-            auto& chunk = scene[chunkIndex];
-            if (pChunk == &chunk)
-                continue;
-            if (chunk.classData.superClassID == OSM_SUPERCLASS_ID) {
-                size_t index = 0;
-                Chunk const* pModifierChunk = nullptr;
-                for (auto& child : (*pChunk)) {
-                    if (child.type == 0x2500) {
-                        if (index == linkIndex) {
-                            pModifierChunk = &child;
-                            break;
-                        }
-                        index++;
-                    }
+    std::lock_guard<std::mutex> lock(channelMutex);
+    auto it = channels.find(index);
+    if (it != channels.end())
+        return &(*it).second;
+    auto source = channelSources.find(index);
+    if (source == channelSources.end())
+        return nullptr;
+    auto& channel = (*channels.try_emplace(index, vertexArray.get_allocator().resource()).first).second;
+    decodeChannel(*this, (*source).second, channel);
+    return &channel;
+}
+
+static void decodeChannels(miMaxMesh& mesh)
+{
+    for (auto& [index, source] : mesh.channelSources) {
+        mesh.getChannel(index);
+    }
+    mesh.channelSources.clear();
+}
+
+static void addChannelSources(miMaxMesh& mesh, Chunk const& polyChunk, uint16_t channelType, uint16_t vertexType, uint16_t faceType, bool polygon)
+{
+    int channel = 1;
+    for (auto& child : polyChunk) {
+        if (child.type == channelType && child.property.size() >= sizeof(int)) {
+            memcpy(&channel, child.property.data(), sizeof(int));
+            continue;
+        }
+        if (child.type != vertexType && child.type != faceType)
+            continue;
+        if (channel < -2 || channel > 99)
+            continue;
+        auto& source = (*mesh.channelSources.try_emplace(channel, mesh.vertexArray.get_allocator().resource()).first).second;
+        source.polygon = polygon;
+        if (child.type == vertexType && source.vertex.empty()) {
+            source.vertex.assign(child.property.begin(), child.property.end());
+        }
+        if (child.type == faceType && source.face.empty()) {
+            source.face.assign(child.property.begin(), child.property.end());
+            channel += 1;
+        }
+    }
+}
+
+// Faces are still in file order here, so sources are checked before the material sort
+static void checkChannelSources(Log const& log, miMaxMesh& mesh, char const* name)
+{
+    for (auto it = mesh.channelSources.begin(); it != mesh.channelSources.end(); ) {
+        auto& [index, source] = *it;
+        uint32_t vertexCount = 0;
+        if (source.vertex.size() >= sizeof(uint32_t))
+            vertexCount = uint32_t((source.vertex.size() / sizeof(float) - 1) / 3);
+        std::vector<uint32_t> face(source.face.size() / sizeof(uint32_t));
+        if (face.empty() == false)
+            memcpy(face.data(), source.face.data(), face.size() * sizeof(uint32_t));
+        if (face.empty()) {
+            it = mesh.channelSources.erase(it);
+            continue;
+        }
+        bool corrupted = false;
+        size_t cornerCount = 0;
+        if (source.polygon) {
+            size_t faceIndex = 0;
+            for (size_t i = 0; i < face.size() && corrupted == false; i += face[i] + 1) {
+                uint32_t count = face[i];
+                if (i + 1 + count > face.size() || faceIndex + 1 >= mesh.faceOffset.size() ||
+                    mesh.faceOffset[faceIndex + 1] - mesh.faceOffset[faceIndex] != count) {
+                    corrupted = true;
+                    break;
                 }
-                if (pModifierChunk == nullptr)
-                    continue;
-                getObjectSpaceModifier(log, scene, chunk, *pModifierChunk, node);
-                continue;
+                corrupted = std::any_of(face.begin() + i + 1, face.begin() + i + 1 + count, [&](uint32_t index) {
+                    return index >= vertexCount;
+                });
+                cornerCount += count;
+                faceIndex += 1;
             }
-            getPrimitive(log, scene, chunk, node);
         }
-        return;
+        else {
+            cornerCount = (face.size() - 1) / 3 * 3;
+            corrupted = std::any_of(face.begin() + 1, face.begin() + 1 + cornerCount, [&](uint32_t index) {
+                return index >= vertexCount;
+            });
+        }
+        if (corrupted || cornerCount != mesh.vertexArray.size()) {
+            log("%s is corrupted (channel %d : %zd:%zd)", name, index, mesh.vertexArray.size(), cornerCount);
+            it = mesh.channelSources.erase(it);
+            continue;
+        }
+        ++it;
     }
-    auto* pParamBlock = getLinkChunk(scene, *pChunk, 0);
-    if (pParamBlock == nullptr)
-        return;
-    auto paramBlock = getParamBlock(*pParamBlock);
+}
 
-    // ????????-00000010-00000000-00000010 Box              BOXOBJ_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
-    // ????????-00000011-00000000-00000010 Sphere           SPHERE_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
-    // ????????-00000012-00000000-00000010 Cylinder         CYLINDER_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
-    // ????????-00000020-00000000-00000010 Torus            TORUS_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
-    // ????????-a86c23dd-00000000-00000010 Cone             CONE_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
-    // ????????-00000000-00007f9e-00000010 GeoSphere        GSPHERE_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
-    // ????????-00007b21-00000000-00000010 Tube             TUBE_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
-    // ????????-76bf318a-4bf37b10-00000010 Pyramid          PYRAMID_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
+static std::string getChannelText(miMaxMesh const& mesh)
+{
+    std::string text;
+    for (auto& [index, source] : mesh.channelSources) {
+        text += format(text.empty() ? "%d" : ", %d", index);
+    }
+    for (auto& [index, channel] : mesh.channels) {
+        text += format(text.empty() ? "%d" : ", %d", index);
+    }
+    return text;
+}
+
+// Worker threads are started once and shared by every parallel loop. A caller waiting
+// for its tasks runs queued tasks itself, so it never blocks while work is pending.
+class ThreadPool
+{
+public:
+    static ThreadPool& instance()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    size_t size() const
+    {
+        return workers.size() + 1;
+    }
+
+    void submit(std::atomic<size_t>& pending, std::function<void()> task)
+    {
+        pending.fetch_add(1);
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.emplace_back([this, &pending, task = std::move(task)]() {
+            task();
+            if (pending.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(mutex);
+                condition.notify_all();
+            }
+        });
+        condition.notify_one();
+    }
+
+    void wait(std::atomic<size_t> const& pending)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (pending != 0) {
+            if (tasks.empty()) {
+                condition.wait(lock);
+                continue;
+            }
+            auto task = std::move(tasks.front());
+            tasks.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stop = false;
+
+    ThreadPool()
+    {
+        size_t count = std::max<size_t>(std::thread::hardware_concurrency(), 1) - 1;
+        for (size_t i = 0; i < count; ++i) {
+            workers.emplace_back([this]() {
+                std::unique_lock<std::mutex> lock(mutex);
+                for (;;) {
+                    condition.wait(lock, [this]() { return stop || tasks.empty() == false; });
+                    if (tasks.empty())
+                        return;
+                    auto task = std::move(tasks.front());
+                    tasks.pop_front();
+                    lock.unlock();
+                    task();
+                    lock.lock();
+                }
+            });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        condition.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+};
+
+// Set while a serial reader is opening a file
+static thread_local bool parallelSerial = false;
+
+// Tasks log to the buffer and allocate from the scratch of the thread that queued them
+struct TaskEnter
+{
+    LogBuffer* previousBuffer;
+    std::pmr::memory_resource* previousScratch;
+
+    TaskEnter(LogBuffer* buffer, std::pmr::memory_resource* scratch) : previousBuffer(logBuffer), previousScratch(threadScratch)
+    {
+        logBuffer = buffer;
+        threadScratch = scratch;
+    }
+
+    ~TaskEnter()
+    {
+        logBuffer = previousBuffer;
+        threadScratch = previousScratch;
+    }
+};
+
+template <typename F>
+static void parallelFor(size_t count, size_t grain, F&& function)
+{
+    auto& pool = ThreadPool::instance();
+    size_t threads = std::min<size_t>(pool.size(), count / std::max<size_t>(grain, 1));
+    if (threads <= 1 || parallelSerial) {
+        function(size_t(0), count);
+        return;
+    }
+    size_t step = (count + threads - 1) / threads;
+    std::atomic<size_t> pending = { 0 };
+    LogBuffer* buffer = logBuffer;
+    std::pmr::memory_resource* scratch = threadScratch;
+    PROFILE_CAPTURE;
+    for (size_t begin = step; begin < count; begin += step) {
+        size_t end = std::min(begin + step, count);
+        pool.submit(pending, [&, begin, end]() {
+            PROFILE_ENTER;
+            TaskEnter taskEnter = { buffer, scratch };
+            function(begin, end);
+        });
+    }
+    function(size_t(0), step);
+    pool.wait(pending);
+}
+
+template <typename F>
+static void parallelForEach(size_t count, F&& function)
+{
+    auto& pool = ThreadPool::instance();
+    size_t threads = std::min<size_t>(pool.size(), count);
+    if (threads <= 1 || parallelSerial) {
+        for (size_t i = 0; i < count; ++i) {
+            function(i);
+        }
+        return;
+    }
+    std::atomic<size_t> next = { 0 };
+    std::atomic<size_t> pending = { 0 };
+    LogBuffer* buffer = logBuffer;
+    std::pmr::memory_resource* scratch = threadScratch;
+    PROFILE_CAPTURE;
+    auto worker = [&]() {
+        PROFILE_ENTER;
+        TaskEnter taskEnter = { buffer, scratch };
+        for (size_t i = next++; i < count; i = next++) {
+            function(i);
+        }
+    };
+    for (size_t i = 1; i < threads; ++i) {
+        pool.submit(pending, worker);
+    }
+    worker();
+    pool.wait(pending);
+}
+
+static Point3 transformPoint(Point3 const& point, miMaxNode const& transform)
+{
+    auto& [px, py, pz] = transform.position;
+    auto& [qx, qy, qz, qw] = transform.rotation;
+    auto& [sx, sy, sz] = transform.scale;
+    float x = point[0] * sx;
+    float y = point[1] * sy;
+    float z = point[2] * sz;
+    float tx = 2.0f * (qy * z - qz * y);
+    float ty = 2.0f * (qz * x - qx * z);
+    float tz = 2.0f * (qx * y - qy * x);
+    return { x + qw * tx + (qy * tz - qz * ty) + px,
+             y + qw * ty + (qz * tx - qx * tz) + py,
+             z + qw * tz + (qx * ty - qy * tx) + pz };
+}
+
+static Point3 inverseTransformPoint(Point3 const& point, miMaxNode const& transform)
+{
+    auto& [px, py, pz] = transform.position;
+    auto& [qx, qy, qz, qw] = transform.rotation;
+    auto& [sx, sy, sz] = transform.scale;
+    float x = point[0] - px;
+    float y = point[1] - py;
+    float z = point[2] - pz;
+    float tx = 2.0f * (-qy * z + qz * y);
+    float ty = 2.0f * (-qz * x + qx * z);
+    float tz = 2.0f * (-qx * y + qy * x);
+    return { (x + qw * tx + (-qy * tz + qz * ty)) / (sx ? sx : 1.0f),
+             (y + qw * ty + (-qz * tx + qx * tz)) / (sy ? sy : 1.0f),
+             (z + qw * tz + (-qx * ty + qy * tx)) / (sz ? sz : 1.0f) };
+}
+
+typedef std::array<float, 12> Matrix;
+
+static Matrix localMatrix(miMaxNode const& node)
+{
+    auto& [px, py, pz] = node.position;
+    auto& [qx, qy, qz, qw] = node.rotation;
+    auto& [sx, sy, sz] = node.scale;
+    return { (1.0f - 2.0f * (qy * qy + qz * qz)) * sx, (2.0f * (qx * qy + qw * qz)) * sx, (2.0f * (qx * qz - qw * qy)) * sx,
+             (2.0f * (qx * qy - qw * qz)) * sy, (1.0f - 2.0f * (qx * qx + qz * qz)) * sy, (2.0f * (qy * qz + qw * qx)) * sy,
+             (2.0f * (qx * qz + qw * qy)) * sz, (2.0f * (qy * qz - qw * qx)) * sz, (1.0f - 2.0f * (qx * qx + qy * qy)) * sz,
+             px, py, pz };
+}
+
+static Point3 transformMatrix(Matrix const& matrix, Point3 const& point, float w = 1.0f)
+{
+    return { matrix[0] * point[0] + matrix[3] * point[1] + matrix[6] * point[2] + matrix[9] * w,
+             matrix[1] * point[0] + matrix[4] * point[1] + matrix[7] * point[2] + matrix[10] * w,
+             matrix[2] * point[0] + matrix[5] * point[1] + matrix[8] * point[2] + matrix[11] * w };
+}
+
+static Matrix multiplyMatrix(Matrix const& parent, Matrix const& local)
+{
+    Matrix output;
+    for (int i = 0; i < 4; ++i) {
+        Point3 axis = transformMatrix(parent, { local[i * 3 + 0], local[i * 3 + 1], local[i * 3 + 2] }, i == 3 ? 1.0f : 0.0f);
+        output[i * 3 + 0] = axis[0];
+        output[i * 3 + 1] = axis[1];
+        output[i * 3 + 2] = axis[2];
+    }
+    return output;
+}
+
+static miMaxBounds transformBounds(Matrix const& matrix, miMaxBounds const& bounds)
+{
+    miMaxBounds output;
+    if (bounds.empty())
+        return output;
+    Point3 center;
+    Point3 extent;
+    for (int i = 0; i < 3; ++i) {
+        center[i] = (bounds.minimum[i] + bounds.maximum[i]) * 0.5f;
+        extent[i] = (bounds.maximum[i] - bounds.minimum[i]) * 0.5f;
+    }
+    center = transformMatrix(matrix, center);
+    for (int i = 0; i < 3; ++i) {
+        float radius = fabsf(matrix[i]) * extent[0] + fabsf(matrix[i + 3]) * extent[1] + fabsf(matrix[i + 6]) * extent[2];
+        output.minimum[i] = center[i] - radius;
+        output.maximum[i] = center[i] + radius;
+    }
+    return output;
+}
+
+static void getBounds(miMaxMesh& mesh)
+{
+    size_t count = mesh.vertex.size();
+    size_t block = 65536;
+    std::vector<miMaxBounds> blocks((count + block - 1) / block);
+    parallelFor(blocks.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t b = begin; b < end; ++b) {
+            Point3 minimum = mesh.vertex[b * block];
+            Point3 maximum = mesh.vertex[b * block];
+            for (size_t i = b * block, last = std::min(count, i + block); i < last; ++i) {
+                auto& point = mesh.vertex[i];
+                minimum = { std::min(minimum[0], point[0]), std::min(minimum[1], point[1]), std::min(minimum[2], point[2]) };
+                maximum = { std::max(maximum[0], point[0]), std::max(maximum[1], point[1]), std::max(maximum[2], point[2]) };
+            }
+            blocks[b].minimum = minimum;
+            blocks[b].maximum = maximum;
+        }
+    });
+    mesh.bounds = {};
+    for (auto& bounds : blocks) {
+        mesh.bounds.merge(bounds);
+    }
+    for (auto& point : mesh.spline.point) {
+        mesh.bounds.merge(point);
+    }
+}
+
+static void getWorldBounds(miMaxNode& node, Matrix const& world)
+{
+    node.hierarchyBounds = node.bounds;
+    for (auto& child : node) {
+        Matrix childWorld = multiplyMatrix(world, localMatrix(child));
+        child.bounds = child.mesh ? transformBounds(childWorld, child.mesh->bounds) : miMaxBounds();
+        getWorldBounds(child, childWorld);
+        node.hierarchyBounds.merge(child.hierarchyBounds);
+    }
+}
+
+// Compact meshes keep their positions quantized
+static size_t getVertexCount(miMaxMesh const& mesh)
+{
+    return mesh.vertex.empty() ? mesh.compact.vertex.size() : mesh.vertex.size();
+}
+
+static Point3 getVertex(miMaxMesh const& mesh, uint32_t index)
+{
+    if (mesh.vertex.empty())
+        return mesh.compact.getVertex(index);
+    return index < mesh.vertex.size() ? mesh.vertex[index] : Point3{};
+}
+
+static Point3 faceNormal(miMaxMesh const& mesh, size_t face)
+{
+    Point3 normal = {};
+    uint32_t begin = mesh.faceOffset[face];
+    uint32_t end = mesh.faceOffset[face + 1];
+    size_t vertexCount = getVertexCount(mesh);
+    for (uint32_t i = begin; i < end; ++i) {
+        uint32_t a = mesh.vertexArray[i];
+        uint32_t b = mesh.vertexArray[i + 1 < end ? i + 1 : begin];
+        if (a >= vertexCount || b >= vertexCount)
+            continue;
+        Point3 p = getVertex(mesh, a);
+        Point3 q = getVertex(mesh, b);
+        normal[0] += (p[1] - q[1]) * (p[2] + q[2]);
+        normal[1] += (p[2] - q[2]) * (p[0] + q[0]);
+        normal[2] += (p[0] - q[0]) * (p[1] + q[1]);
+    }
+    float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    if (length > 0.0f) {
+        normal[0] /= length;
+        normal[1] /= length;
+        normal[2] /= length;
+    }
+    return normal;
+}
+
+// Ear clipping on the plane of the face, so concave polygons are covered exactly once.
+// Corners of the triangles are appended, and the rest falls back to a fan when no ear is left.
+static void triangulateFace(miMaxMesh const& mesh, size_t face, std::pmr::vector<uint32_t>& triangles)
+{
+    uint32_t first = mesh.faceOffset[face];
+    uint32_t last = mesh.faceOffset[face + 1];
+    size_t vertexCount = getVertexCount(mesh);
+    bool valid = std::all_of(mesh.vertexArray.begin() + first, mesh.vertexArray.begin() + last, [&](uint32_t index) {
+        return index < vertexCount;
+    });
+    std::vector<uint32_t> polygon;
+    for (uint32_t i = first; i < last; ++i) {
+        polygon.push_back(i);
+    }
+    if (polygon.size() > 3 && valid) {
+        Point3 normal = faceNormal(mesh, face);
+        int axis = (fabsf(normal[0]) > fabsf(normal[1])) ? 0 : 1;
+        if (fabsf(normal[2]) > fabsf(normal[axis]))
+            axis = 2;
+        int u = (axis + 1) % 3;
+        int v = (axis + 2) % 3;
+        float sign = normal[axis] < 0.0f ? -1.0f : 1.0f;
+        auto point = [&](uint32_t corner) {
+            return getVertex(mesh, mesh.vertexArray[corner]);
+        };
+        auto area = [&](uint32_t a, uint32_t b, uint32_t c) {
+            Point3 p = point(a);
+            Point3 q = point(b);
+            Point3 r = point(c);
+            return ((q[u] - p[u]) * (r[v] - p[v]) - (q[v] - p[v]) * (r[u] - p[u])) * sign;
+        };
+        size_t i = 0;
+        size_t miss = 0;
+        while (polygon.size() > 3 && miss < polygon.size()) {
+            size_t count = polygon.size();
+            uint32_t a = polygon[(i + count - 1) % count];
+            uint32_t b = polygon[i % count];
+            uint32_t c = polygon[(i + 1) % count];
+            bool ear = area(a, b, c) > 0.0f;
+            for (size_t j = 0; j < count && ear; ++j) {
+                uint32_t d = polygon[j];
+                if (d == a || d == b || d == c || mesh.vertexArray[d] == mesh.vertexArray[a] ||
+                    mesh.vertexArray[d] == mesh.vertexArray[b] || mesh.vertexArray[d] == mesh.vertexArray[c])
+                    continue;
+                if (area(a, b, d) >= 0.0f && area(b, c, d) >= 0.0f && area(c, a, d) >= 0.0f)
+                    ear = false;
+            }
+            if (ear == false) {
+                i = (i + 1) % count;
+                miss++;
+                continue;
+            }
+            triangles.insert(triangles.end(), { a, b, c });
+            polygon.erase(polygon.begin() + i % count);
+            i = (i + polygon.size() - 1) % polygon.size();
+            miss = 0;
+        }
+    }
+    for (size_t i = 1; i + 1 < polygon.size(); ++i) {
+        triangles.insert(triangles.end(), { polygon[0], polygon[i], polygon[i + 1] });
+    }
+}
+
+static Chunk const* getLinkSuperClass(Context const& context, Chunk const& chunk, uint32_t superClassID)
+{
+    auto& scene = context.scene;
+    for (auto [linkIndex, chunkIndex] : getLink(chunk)) {
+        if (scene.size() <= chunkIndex)
+            continue;
+        if (getClassData(context, scene[chunkIndex]).superClassID == superClassID)
+            return &scene[chunkIndex];
+    }
+    return nullptr;
+}
+
+static Chunk const* getGizmo(Context const& context, Chunk const& chunk)
+{
+    return getLinkSuperClass(context, chunk, MATRIX3_SUPERCLASS_ID);
+}
+
+// The center of a modifier is a position controller next to its gizmo
+static Point3 getGizmoCenter(Context const& context, Chunk const& chunk)
+{
+    Point3 center = {};
+    auto* pCenter = getLinkSuperClass(context, chunk, POSITION_SUPERCLASS_ID);
+    if (pCenter && getPosition(context, *pCenter, center) == false) {
+        checkClass(context, *pCenter, {}, 0);
+    }
+    return center;
+}
+
+// Points are transformed around the center : p' = T(p - center) + center
+static void transformMesh(miMaxMesh& mesh, miMaxNode const& transform, Point3 const& center = {})
+{
+    auto pivot = [&](Point3 point) {
+        point = transformPoint({ point[0] - center[0], point[1] - center[1], point[2] - center[2] }, transform);
+        return Point3{ point[0] + center[0], point[1] + center[1], point[2] + center[2] };
+    };
+    parallelFor(mesh.vertex.size(), 16384, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            mesh.vertex[i] = pivot(mesh.vertex[i]);
+        }
+    });
+    for (auto* points : { &mesh.spline.knot, &mesh.spline.inTangent, &mesh.spline.outTangent, &mesh.spline.point }) {
+        for (auto& point : *points) {
+            point = pivot(point);
+        }
+    }
+    miMaxNode rotation;
+    rotation.rotation = transform.rotation;
+    parallelFor(mesh.normal.size(), 16384, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            mesh.normal[i] = transformPoint(mesh.normal[i], rotation);
+        }
+    });
+}
+
+// Inverse of transformMesh : p' = T^-1(p - center) + center
+static void inverseTransformMesh(miMaxMesh& mesh, miMaxNode const& transform, Point3 const& center = {})
+{
+    auto pivot = [&](Point3 point) {
+        point = inverseTransformPoint({ point[0] - center[0], point[1] - center[1], point[2] - center[2] }, transform);
+        return Point3{ point[0] + center[0], point[1] + center[1], point[2] + center[2] };
+    };
+    parallelFor(mesh.vertex.size(), 16384, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            mesh.vertex[i] = pivot(mesh.vertex[i]);
+        }
+    });
+    for (auto* points : { &mesh.spline.knot, &mesh.spline.inTangent, &mesh.spline.outTangent, &mesh.spline.point }) {
+        for (auto& point : *points) {
+            point = pivot(point);
+        }
+    }
+    miMaxNode rotation;
+    rotation.rotation = transform.rotation;
+    parallelFor(mesh.normal.size(), 16384, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            mesh.normal[i] = inverseTransformPoint(mesh.normal[i], rotation);
+        }
+    });
+}
+
+static void reverseFaces(miMaxMesh& mesh, size_t faceBegin)
+{
+    size_t faceCount = mesh.faceOffset.size() - 1;
+    for (size_t i = faceBegin; i < faceCount; ++i) {
+        uint32_t begin = mesh.faceOffset[i];
+        uint32_t end = mesh.faceOffset[i + 1];
+        std::reverse(mesh.vertexArray.begin() + begin, mesh.vertexArray.begin() + end);
+        for (auto& [index, channel] : mesh.channels) {
+            if (channel.index.size() == mesh.vertexArray.size()) {
+                std::reverse(channel.index.begin() + begin, channel.index.begin() + end);
+            }
+        }
+    }
+}
+
+// The mirror planes pass through the center, moved by half of the offset
+static void mirrorMesh(miMaxMesh& mesh, int axis, bool copy, float offset, Point3 const& center = {})
+{
+    static uint8_t const axes[6] = { 0b001, 0b010, 0b100, 0b011, 0b110, 0b101 };
+    uint8_t mask = axes[std::clamp(axis, 0, 5)];
+    bool reverse = (mask == 0b001 || mask == 0b010 || mask == 0b100);
+
+    decodeChannels(mesh);
+    size_t vertexCount = mesh.vertex.size();
+    size_t normalCount = mesh.normal.size();
+    size_t faceCount = mesh.faceOffset.size() - 1;
+    if (copy) {
+        size_t indexCount = mesh.vertexArray.size();
+        mesh.vertex.insert(mesh.vertex.end(), mesh.vertex.begin(), mesh.vertex.end());
+        mesh.normal.insert(mesh.normal.end(), mesh.normal.begin(), mesh.normal.end());
+        mesh.vertexArray.insert(mesh.vertexArray.end(), mesh.vertexArray.begin(), mesh.vertexArray.end());
+        for (size_t i = indexCount; i < mesh.vertexArray.size(); ++i) {
+            mesh.vertexArray[i] += uint32_t(vertexCount);
+        }
+        for (size_t i = 1; i <= faceCount; ++i) {
+            mesh.faceOffset.push_back(mesh.faceOffset[i] + uint32_t(indexCount));
+        }
+        for (auto& [index, channel] : mesh.channels) {
+            if (channel.index.size() == indexCount) {
+                channel.index.insert(channel.index.end(), channel.index.begin(), channel.index.end());
+            }
+        }
+        if (mesh.smoothingGroup.size() == faceCount) {
+            mesh.smoothingGroup.insert(mesh.smoothingGroup.end(), mesh.smoothingGroup.begin(), mesh.smoothingGroup.end());
+        }
+        if (mesh.materialID.size() == faceCount) {
+            mesh.materialID.insert(mesh.materialID.end(), mesh.materialID.begin(), mesh.materialID.end());
+        }
+    }
+
+    size_t vertexBegin = copy ? vertexCount : 0;
+    parallelFor(mesh.vertex.size() - vertexBegin, 16384, [&](size_t begin, size_t end) {
+        for (size_t i = vertexBegin + begin; i < vertexBegin + end; ++i) {
+            for (int a = 0; a < 3; ++a) {
+                if (mask & (1 << a)) {
+                    mesh.vertex[i][a] = 2.0f * center[a] + offset - mesh.vertex[i][a];
+                }
+            }
+        }
+    });
+    for (size_t i = copy ? normalCount : 0; i < mesh.normal.size(); ++i) {
+        for (int a = 0; a < 3; ++a) {
+            if (mask & (1 << a)) {
+                mesh.normal[i][a] = -mesh.normal[i][a];
+            }
+        }
+    }
+    if (reverse) {
+        reverseFaces(mesh, copy ? faceCount : 0);
+    }
+}
+
+static void symmetryMesh(miMaxMesh& mesh, int axis, bool flip, bool weld, float threshold)
+{
+    axis = std::clamp(axis, 0, 2);
+    float sign = flip ? -1.0f : 1.0f;
+    size_t faceCount = mesh.faceOffset.size() - 1;
+    bool smoothing = (mesh.smoothingGroup.size() == faceCount);
+    bool material = (mesh.materialID.size() == faceCount);
+
+    decodeChannels(mesh);
+    std::vector<miMaxMesh::Channel*> channels;
+    std::vector<miMaxMesh::Channel*> vertexChannels;
+    for (auto& [index, channel] : mesh.channels) {
+        if (channel.index.size() == mesh.vertexArray.size()) {
+            channels.push_back(&channel);
+        }
+        else if (channel.index.empty() && channel.u.size() == mesh.vertex.size()) {
+            vertexChannels.push_back(&channel);
+        }
+    }
+    auto lerp = [](miMaxMesh::Channel& channel, uint32_t a, uint32_t b, float t) {
+        channel.u.push_back(channel.u[a] + (channel.u[b] - channel.u[a]) * t);
+        channel.v.push_back(channel.v[a] + (channel.v[b] - channel.v[a]) * t);
+        channel.w.push_back(channel.w[a] + (channel.w[b] - channel.w[a]) * t);
+        return uint32_t(channel.u.size() - 1);
+    };
+
+    // Keep the faces on the positive side of the plane, and slice the ones crossing it.
+    // Cuts are cached by edge, so neighbouring faces share the new vertices.
+    auto* resource = mesh.vertexArray.get_allocator().resource();
+    std::pmr::vector<uint32_t> vertexArray(resource);
+    std::pmr::vector<uint32_t> faceOffset(1, 0, resource);
+    std::vector<std::pmr::vector<uint32_t>> channelArray(channels.size(), std::pmr::vector<uint32_t>(resource));
+    std::pmr::vector<uint32_t> smoothingGroup(resource);
+    std::pmr::vector<uint16_t> materialID(resource);
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t> vertexCut;
+    std::vector<std::map<std::pair<uint32_t, uint32_t>, uint32_t>> channelCut(channels.size());
+    auto distance = [&](uint32_t index) {
+        return mesh.vertex[index][axis] * sign;
+    };
+    auto cut = [&](std::map<std::pair<uint32_t, uint32_t>, uint32_t>& cache, uint32_t a, uint32_t b, float t, auto&& create) {
+        if (a > b) {
+            std::swap(a, b);
+            t = 1.0f - t;
+        }
+        auto [it, inserted] = cache.try_emplace({ a, b }, 0);
+        if (inserted)
+            it->second = create(a, b, t);
+        return it->second;
+    };
+    for (size_t i = 0; i < faceCount; ++i) {
+        uint32_t begin = mesh.faceOffset[i];
+        uint32_t end = mesh.faceOffset[i + 1];
+        bool valid = std::all_of(mesh.vertexArray.begin() + begin, mesh.vertexArray.begin() + end, [&](uint32_t index) {
+            return index < mesh.vertex.size();
+        });
+        if (valid == false)
+            continue;
+        size_t first = vertexArray.size();
+        for (uint32_t j = begin; j < end; ++j) {
+            uint32_t k = (j + 1 < end) ? j + 1 : begin;
+            uint32_t a = mesh.vertexArray[j];
+            uint32_t b = mesh.vertexArray[k];
+            float da = distance(a);
+            float db = distance(b);
+            if (da >= -threshold) {
+                vertexArray.push_back(a);
+                for (size_t c = 0; c < channels.size(); ++c) {
+                    channelArray[c].push_back(channels[c]->index[j]);
+                }
+            }
+            if ((da > threshold && db < -threshold) || (da < -threshold && db > threshold)) {
+                float t = da / (da - db);
+                vertexArray.push_back(cut(vertexCut, a, b, t, [&](uint32_t a, uint32_t b, float t) {
+                    auto& p = mesh.vertex[a];
+                    auto& q = mesh.vertex[b];
+                    Point3 point = { p[0] + (q[0] - p[0]) * t, p[1] + (q[1] - p[1]) * t, p[2] + (q[2] - p[2]) * t };
+                    point[axis] = 0.0f;
+                    mesh.vertex.push_back(point);
+                    for (auto* channel : vertexChannels) {
+                        lerp(*channel, a, b, t);
+                    }
+                    return uint32_t(mesh.vertex.size() - 1);
+                }));
+                for (size_t c = 0; c < channels.size(); ++c) {
+                    auto& channel = *channels[c];
+                    uint32_t ca = channel.index[j];
+                    uint32_t cb = channel.index[k];
+                    if (ca >= channel.u.size() || cb >= channel.u.size()) {
+                        channelArray[c].push_back(ca);
+                        continue;
+                    }
+                    channelArray[c].push_back(cut(channelCut[c], ca, cb, t, [&](uint32_t a, uint32_t b, float t) {
+                        return lerp(channel, a, b, t);
+                    }));
+                }
+            }
+        }
+        if (vertexArray.size() - first < 3) {
+            vertexArray.resize(first);
+            for (auto& array : channelArray) {
+                array.resize(first);
+            }
+            continue;
+        }
+        faceOffset.push_back(uint32_t(vertexArray.size()));
+        if (smoothing)
+            smoothingGroup.push_back(mesh.smoothingGroup[i]);
+        if (material)
+            materialID.push_back(mesh.materialID[i]);
+    }
+
+    // Mirror the kept vertices, sharing the ones on the plane
+    std::vector<uint32_t> mirror(mesh.vertex.size(), UINT32_MAX);
+    for (size_t i = 0, count = faceOffset.size() - 1; i < count; ++i) {
+        uint32_t begin = faceOffset[i];
+        uint32_t end = faceOffset[i + 1];
+        for (uint32_t j = end; j > begin; --j) {
+            uint32_t index = vertexArray[j - 1];
+            auto& vertex = mesh.vertex[index];
+            if (fabsf(vertex[axis]) <= threshold) {
+                if (weld)
+                    vertex[axis] = 0.0f;
+            }
+            else {
+                if (mirror[index] == UINT32_MAX) {
+                    mirror[index] = uint32_t(mesh.vertex.size());
+                    Point3 point = vertex;
+                    point[axis] = -point[axis];
+                    mesh.vertex.push_back(point);
+                    for (auto* channel : vertexChannels) {
+                        lerp(*channel, index, index, 0.0f);
+                    }
+                }
+                index = mirror[index];
+            }
+            vertexArray.push_back(index);
+            for (size_t c = 0; c < channels.size(); ++c) {
+                channelArray[c].push_back(channelArray[c][j - 1]);
+            }
+        }
+        faceOffset.push_back(uint32_t(vertexArray.size()));
+        if (smoothing) {
+            smoothingGroup.push_back(smoothingGroup[i]);
+        }
+        if (material) {
+            materialID.push_back(materialID[i]);
+        }
+    }
+
+    mesh.vertexArray = std::move(vertexArray);
+    mesh.faceOffset = std::move(faceOffset);
+    for (size_t c = 0; c < channels.size(); ++c) {
+        channels[c]->index = std::move(channelArray[c]);
+    }
+    if (smoothing)
+        mesh.smoothingGroup = std::move(smoothingGroup);
+    if (material)
+        mesh.materialID = std::move(materialID);
+    mesh.normal.clear();
+}
+
+static void uvwMapMesh(miMaxMesh& mesh, int type, Point3 tile, Point3 flip, Point3 size, miMaxNode const& gizmo)
+{
+    static constexpr float pi = 3.14159265358979f;
+    for (auto& value : size) {
+        if (value == 0.0f)
+            value = 1.0f;
+    }
+    auto finish = [&](Point3& uvw) {
+        for (int a = 0; a < 3; ++a) {
+            uvw[a] = (flip[a] ? 1.0f - uvw[a] : uvw[a]) * tile[a];
+        }
+    };
+
+    mesh.channelSources.erase(1);
+    auto& channel = mesh.channels[1];
+    switch (type) {
+    case 0:     // Planar
+    case 1:     // Cylindrical
+    case 2:     // Spherical
+    case 3:     // Shrink Wrap
+    case 6:     // XYZ to UVW
+        channel.u.resize(mesh.vertex.size());
+        channel.v.resize(mesh.vertex.size());
+        channel.w.resize(mesh.vertex.size());
+        parallelFor(mesh.vertex.size(), 16384, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                auto [x, y, z] = inverseTransformPoint(mesh.vertex[i], gizmo);
+                Point3 uvw;
+                switch (type) {
+                case 0:
+                    uvw = { x / size[1] + 0.5f, y / size[0] + 0.5f, 0.0f };
+                    break;
+                case 1:
+                    uvw = { atan2f(y, x) / (2.0f * pi) + 0.5f, z / size[2] + 0.5f, 0.0f };
+                    break;
+                case 2:
+                case 3:
+                    uvw = { atan2f(y, x) / (2.0f * pi) + 0.5f, atan2f(z, sqrtf(x * x + y * y)) / pi + 0.5f, 0.0f };
+                    break;
+                default:
+                    uvw = { x, y, z };
+                    break;
+                }
+                finish(uvw);
+                channel.u[i] = uvw[0];
+                channel.v[i] = uvw[1];
+                channel.w[i] = uvw[2];
+            }
+        });
+        channel.index = mesh.vertexArray;
+        break;
+    case 4:     // Box
+    case 5: {   // Face
+        channel.u.clear();
+        channel.v.clear();
+        channel.w.clear();
+        channel.index.clear();
+        channel.index.reserve(mesh.vertexArray.size());
+        for (size_t f = 0; f + 1 < mesh.faceOffset.size(); ++f) {
+            auto normal = inverseTransformPoint(faceNormal(mesh, f), gizmo);
+            int a = (fabsf(normal[0]) > fabsf(normal[1])) ? 0 : 1;
+            if (fabsf(normal[2]) > fabsf(normal[a]))
+                a = 2;
+            for (uint32_t i = mesh.faceOffset[f]; i < mesh.faceOffset[f + 1]; ++i) {
+                uint32_t corner = i - mesh.faceOffset[f];
+                Point3 uvw = {};
+                if (type == 5) {
+                    uvw = { (corner == 1 || corner == 2) ? 1.0f : 0.0f, (corner >= 2) ? 1.0f : 0.0f, 0.0f };
+                }
+                else if (mesh.vertexArray[i] < mesh.vertex.size()) {
+                    auto point = inverseTransformPoint(mesh.vertex[mesh.vertexArray[i]], gizmo);
+                    int u = (a + 1) % 3;
+                    int v = (a + 2) % 3;
+                    uvw = { point[u] / size[u] + 0.5f, point[v] / size[v] + 0.5f, 0.0f };
+                }
+                finish(uvw);
+                channel.index.push_back(uint32_t(channel.u.size()));
+                channel.u.push_back(uvw[0]);
+                channel.v.push_back(uvw[1]);
+                channel.w.push_back(uvw[2]);
+            }
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void triangulateMesh(miMaxMesh& mesh)
+{
+    size_t faceCount = mesh.faceOffset.size() - 1;
+    bool smoothing = (mesh.smoothingGroup.size() == faceCount);
+    bool material = (mesh.materialID.size() == faceCount);
+
+    decodeChannels(mesh);
+    std::vector<miMaxMesh::Channel*> channels;
+    for (auto& [index, channel] : mesh.channels) {
+        if (channel.index.size() == mesh.vertexArray.size()) {
+            channels.push_back(&channel);
+        }
+    }
+
+    auto* resource = mesh.vertexArray.get_allocator().resource();
+    std::pmr::vector<uint32_t> corners(getScratch());
+    std::pmr::vector<uint32_t> faceOffset(1, 0, resource);
+    std::pmr::vector<uint32_t> smoothingGroup(resource);
+    std::pmr::vector<uint16_t> materialID(resource);
+    corners.reserve(mesh.vertexArray.size() * 2);
+    faceOffset.reserve(faceCount * 2);
+    for (size_t i = 0; i < faceCount; ++i) {
+        uint32_t begin = mesh.faceOffset[i];
+        uint32_t end = mesh.faceOffset[i + 1];
+        if (end - begin < 3)
+            continue;
+        triangulateFace(mesh, i, corners);
+        for (uint32_t j = begin + 2; j < end; ++j) {
+            faceOffset.push_back(faceOffset.back() + 3);
+            if (smoothing) {
+                smoothingGroup.push_back(mesh.smoothingGroup[i]);
+            }
+            if (material) {
+                materialID.push_back(mesh.materialID[i]);
+            }
+        }
+    }
+
+    std::pmr::vector<uint32_t> vertexArray(corners.size(), resource);
+    for (size_t i = 0; i < corners.size(); ++i) {
+        vertexArray[i] = mesh.vertexArray[corners[i]];
+    }
+    for (auto* channel : channels) {
+        std::pmr::vector<uint32_t> index(corners.size(), resource);
+        for (size_t i = 0; i < corners.size(); ++i) {
+            index[i] = channel->index[corners[i]];
+        }
+        channel->index = std::move(index);
+    }
+    if (mesh.normal.size() == mesh.vertexArray.size()) {
+        std::pmr::vector<Point3> normal(corners.size(), resource);
+        for (size_t i = 0; i < corners.size(); ++i) {
+            normal[i] = mesh.normal[corners[i]];
+        }
+        mesh.normal = std::move(normal);
+    }
+    mesh.vertexArray = std::move(vertexArray);
+    mesh.faceOffset = std::move(faceOffset);
+    if (smoothing)
+        mesh.smoothingGroup = std::move(smoothingGroup);
+    if (material)
+        mesh.materialID = std::move(materialID);
+}
+
+// Turn to Poly : two triangles sharing an edge become a quad when they lie in one plane,
+// have the same material and smoothing, agree on every channel along the edge and the
+// quad is convex. Edge visibility is not decoded, so larger polygons are not rebuilt.
+static void polygonizeMesh(miMaxMesh& mesh)
+{
+    size_t faceCount = mesh.faceOffset.size() - 1;
+    bool smoothing = (mesh.smoothingGroup.size() == faceCount);
+    bool material = (mesh.materialID.size() == faceCount);
+
+    decodeChannels(mesh);
+    std::vector<miMaxMesh::Channel*> channels;
+    for (auto& [index, channel] : mesh.channels) {
+        if (channel.index.size() == mesh.vertexArray.size()) {
+            channels.push_back(&channel);
+        }
+    }
+    auto triangle = [&](size_t face) {
+        uint32_t begin = mesh.faceOffset[face];
+        if (mesh.faceOffset[face + 1] - begin != 3)
+            return false;
+        return std::all_of(mesh.vertexArray.begin() + begin, mesh.vertexArray.begin() + begin + 3, [&](uint32_t index) {
+            return index < mesh.vertex.size();
+        });
+    };
+    auto* scratch = getScratch();
+    std::pmr::vector<uint32_t> cornerFace(mesh.vertexArray.size(), scratch);
+    for (size_t i = 0; i < faceCount; ++i) {
+        std::fill(cornerFace.begin() + mesh.faceOffset[i], cornerFace.begin() + mesh.faceOffset[i + 1], uint32_t(i));
+    }
+    auto next = [&](uint32_t corner, uint32_t step = 1) {
+        uint32_t begin = mesh.faceOffset[cornerFace[corner]];
+        return begin + (corner - begin + step) % 3;
+    };
+
+    // Corners of the opposite half edge, when exactly two triangles share an edge
+    std::pmr::vector<std::pair<uint64_t, uint32_t>> edges(scratch);
+    for (size_t i = 0; i < faceCount; ++i) {
+        if (triangle(i) == false)
+            continue;
+        for (uint32_t j = mesh.faceOffset[i]; j < mesh.faceOffset[i + 1]; ++j) {
+            uint64_t a = mesh.vertexArray[j];
+            uint64_t b = mesh.vertexArray[next(j)];
+            edges.emplace_back(std::min(a, b) << 32 | std::max(a, b), j);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    std::pmr::vector<uint32_t> opposite(mesh.vertexArray.size(), UINT32_MAX, scratch);
+    for (size_t i = 0; i < edges.size(); ) {
+        size_t j = i + 1;
+        while (j < edges.size() && edges[j].first == edges[i].first)
+            ++j;
+        if (j - i == 2) {
+            uint32_t a = edges[i].second;
+            uint32_t b = edges[i + 1].second;
+            if (mesh.vertexArray[a] == mesh.vertexArray[next(b)] && mesh.vertexArray[b] == mesh.vertexArray[next(a)]) {
+                opposite[a] = b;
+                opposite[b] = a;
+            }
+        }
+        i = j;
+    }
+
+    std::pmr::vector<Point3> normals(faceCount, scratch);
+    parallelFor(faceCount, 4096, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            normals[i] = faceNormal(mesh, i);
+        }
+    });
+    auto convex = [&](std::array<uint32_t, 4> const& quad, Point3 const& normal) {
+        for (size_t i = 0; i < 4; ++i) {
+            auto& p = mesh.vertex[mesh.vertexArray[quad[i]]];
+            auto& q = mesh.vertex[mesh.vertexArray[quad[(i + 1) % 4]]];
+            auto& r = mesh.vertex[mesh.vertexArray[quad[(i + 2) % 4]]];
+            Point3 u = { q[0] - p[0], q[1] - p[1], q[2] - p[2] };
+            Point3 v = { r[0] - q[0], r[1] - q[1], r[2] - q[2] };
+            Point3 w = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+            if (w[0] * normal[0] + w[1] * normal[1] + w[2] * normal[2] <= 0.0f)
+                return false;
+        }
+        return true;
+    };
+
+    auto* resource = mesh.vertexArray.get_allocator().resource();
+    std::pmr::vector<uint32_t> corners(scratch);
+    std::pmr::vector<bool> merged(faceCount, false, scratch);
+    std::pmr::vector<uint32_t> faceOffset(1, 0, resource);
+    std::pmr::vector<uint32_t> smoothingGroup(resource);
+    std::pmr::vector<uint16_t> materialID(resource);
+    corners.reserve(mesh.vertexArray.size());
+    faceOffset.reserve(faceCount + 1);
+    for (size_t i = 0; i < faceCount; ++i) {
+        if (merged[i])
+            continue;
+        uint32_t begin = mesh.faceOffset[i];
+        uint32_t end = mesh.faceOffset[i + 1];
+        bool quad = false;
+        for (uint32_t j = begin; j < end && triangle(i) && quad == false; ++j) {
+            uint32_t k = opposite[j];
+            if (k == UINT32_MAX)
+                continue;
+            size_t f = cornerFace[k];
+            if (f <= i || merged[f])
+                continue;
+            if (smoothing && mesh.smoothingGroup[i] != mesh.smoothingGroup[f])
+                continue;
+            if (material && mesh.materialID[i] != mesh.materialID[f])
+                continue;
+            auto& n = normals[i];
+            auto& m = normals[f];
+            if (n[0] * m[0] + n[1] * m[1] + n[2] * m[2] < 0.9999f)
+                continue;
+            uint32_t j1 = next(j);
+            uint32_t j2 = next(j, 2);
+            uint32_t k1 = next(k);
+            uint32_t k2 = next(k, 2);
+            bool seam = std::any_of(channels.begin(), channels.end(), [&](miMaxMesh::Channel* channel) {
+                return channel->index[j] != channel->index[k1] || channel->index[j1] != channel->index[k];
+            });
+            if (seam)
+                continue;
+            std::array<uint32_t, 4> corner = { j, k2, j1, j2 };
+            if (convex(corner, n) == false)
+                continue;
+            corners.insert(corners.end(), corner.begin(), corner.end());
+            merged[f] = true;
+            quad = true;
+        }
+        if (quad == false) {
+            for (uint32_t j = begin; j < end; ++j) {
+                corners.push_back(j);
+            }
+        }
+        faceOffset.push_back(uint32_t(corners.size()));
+        if (smoothing) {
+            smoothingGroup.push_back(mesh.smoothingGroup[i]);
+        }
+        if (material) {
+            materialID.push_back(mesh.materialID[i]);
+        }
+    }
+
+    std::pmr::vector<uint32_t> vertexArray(corners.size(), resource);
+    for (size_t i = 0; i < corners.size(); ++i) {
+        vertexArray[i] = mesh.vertexArray[corners[i]];
+    }
+    for (auto* channel : channels) {
+        std::pmr::vector<uint32_t> index(corners.size(), resource);
+        for (size_t i = 0; i < corners.size(); ++i) {
+            index[i] = channel->index[corners[i]];
+        }
+        channel->index = std::move(index);
+    }
+    if (mesh.normal.size() == mesh.vertexArray.size()) {
+        std::pmr::vector<Point3> normal(corners.size(), resource);
+        for (size_t i = 0; i < corners.size(); ++i) {
+            normal[i] = mesh.normal[corners[i]];
+        }
+        mesh.normal = std::move(normal);
+    }
+    mesh.vertexArray = std::move(vertexArray);
+    mesh.faceOffset = std::move(faceOffset);
+    if (smoothing)
+        mesh.smoothingGroup = std::move(smoothingGroup);
+    if (material)
+        mesh.materialID = std::move(materialID);
+}
+
+static void smoothMesh(miMaxMesh& mesh, bool autoSmooth, float threshold, uint32_t smoothingBits)
+{
+    size_t faceCount = mesh.faceOffset.size() - 1;
+    if (autoSmooth == false) {
+        mesh.smoothingGroup.assign(faceCount, smoothingBits);
+        return;
+    }
+
+    std::vector<Point3> normals(faceCount);
+    parallelFor(normals.size(), 4096, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            normals[i] = faceNormal(mesh, i);
+        }
+    });
+
+    // Faces sharing an edge within the threshold angle are smoothed together
+    std::map<std::pair<uint32_t, uint32_t>, std::vector<uint32_t>> edges;
+    for (uint32_t i = 0; i < faceCount; ++i) {
+        uint32_t begin = mesh.faceOffset[i];
+        uint32_t end = mesh.faceOffset[i + 1];
+        for (uint32_t j = begin; j < end; ++j) {
+            uint32_t a = mesh.vertexArray[j];
+            uint32_t b = mesh.vertexArray[j + 1 < end ? j + 1 : begin];
+            edges[{ std::min(a, b), std::max(a, b) }].push_back(i);
+        }
+    }
+    float cosThreshold = cosf(threshold);
+    std::vector<std::vector<uint32_t>> neighbors(faceCount);
+    for (auto& [edge, faces] : edges) {
+        for (size_t i = 0; i < faces.size(); ++i) {
+            for (size_t j = i + 1; j < faces.size(); ++j) {
+                neighbors[faces[i]].push_back(faces[j]);
+                neighbors[faces[j]].push_back(faces[i]);
+            }
+        }
+    }
+
+    mesh.smoothingGroup.assign(faceCount, 0);
+    std::vector<uint32_t> cluster;
+    for (uint32_t i = 0; i < faceCount; ++i) {
+        if (mesh.smoothingGroup[i])
+            continue;
+        cluster.assign(1, i);
+        uint32_t used = 0;
+        for (size_t j = 0; j < cluster.size(); ++j) {
+            auto& a = normals[cluster[j]];
+            mesh.smoothingGroup[cluster[j]] = UINT32_MAX;
+            for (uint32_t neighbor : neighbors[cluster[j]]) {
+                auto& b = normals[neighbor];
+                if (mesh.smoothingGroup[neighbor] == UINT32_MAX)
+                    continue;
+                if (a[0] * b[0] + a[1] * b[1] + a[2] * b[2] < cosThreshold) {
+                    used |= mesh.smoothingGroup[neighbor];
+                    continue;
+                }
+                mesh.smoothingGroup[neighbor] = UINT32_MAX;
+                cluster.push_back(neighbor);
+            }
+        }
+        uint32_t bit = ~used & (used + 1);
+        for (uint32_t face : cluster) {
+            mesh.smoothingGroup[face] = bit ? bit : 1;
+        }
+    }
+}
+
+template <typename F>
+static void subdivideBezier(Point3 const (&control)[4], float flatness, int depth, F&& emit)
+{
+    // Handles close to the chord mean low curvature, the segment is emitted without its end point
+    auto distance = [](Point3 const& a, Point3 const& b) {
+        return sqrtf((a[0] - b[0]) * (a[0] - b[0]) + (a[1] - b[1]) * (a[1] - b[1]) + (a[2] - b[2]) * (a[2] - b[2]));
+    };
+    auto lerp = [](Point3 const& a, Point3 const& b, float t) {
+        return Point3{ a[0] + (b[0] - a[0]) * t, a[1] + (b[1] - a[1]) * t, a[2] + (b[2] - a[2]) * t };
+    };
+    float length = distance(control[0], control[1]) + distance(control[1], control[2]) + distance(control[2], control[3]);
+    float deviation = std::max(distance(control[1], lerp(control[0], control[3], 1.0f / 3.0f)),
+                               distance(control[2], lerp(control[0], control[3], 2.0f / 3.0f)));
+    if (depth == 0 || deviation <= flatness * length) {
+        emit(control[0]);
+        return;
+    }
+    Point3 p01 = lerp(control[0], control[1], 0.5f);
+    Point3 p12 = lerp(control[1], control[2], 0.5f);
+    Point3 p23 = lerp(control[2], control[3], 0.5f);
+    Point3 p012 = lerp(p01, p12, 0.5f);
+    Point3 p123 = lerp(p12, p23, 0.5f);
+    Point3 middle = lerp(p012, p123, 0.5f);
+    Point3 const left[4] = { control[0], p01, p012, middle };
+    Point3 const right[4] = { middle, p123, p23, control[3] };
+    subdivideBezier(left, flatness, depth - 1, emit);
+    subdivideBezier(right, flatness, depth - 1, emit);
+}
+
+static void sampleSpline(miMaxSpline& spline, float flatness)
+{
+    struct Segment
+    {
+        uint32_t begin;
+        uint32_t end;
+    };
+    std::vector<Segment> segments;
+    std::vector<uint32_t> splineSegments(1, 0);
+    size_t splineCount = spline.knotOffset.size() - 1;
+    for (size_t i = 0; i < splineCount; ++i) {
+        uint32_t begin = spline.knotOffset[i];
+        uint32_t end = spline.knotOffset[i + 1];
+        for (uint32_t j = begin; j + 1 < end; ++j) {
+            segments.push_back({ j, j + 1 });
+        }
+        if (spline.closed[i] && end - begin > 1) {
+            segments.push_back({ end - 1, begin });
+        }
+        splineSegments.push_back(uint32_t(segments.size()));
+    }
+
+    // Count first, then every segment writes its own range
+    auto control = [&](Segment const& segment, Point3 (&output)[4]) {
+        output[0] = spline.knot[segment.begin];
+        output[1] = spline.outTangent[segment.begin];
+        output[2] = spline.inTangent[segment.end];
+        output[3] = spline.knot[segment.end];
+    };
+    std::vector<uint32_t> pointOffset(segments.size() + 1);
+    parallelFor(segments.size(), 256, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            Point3 points[4];
+            control(segments[i], points);
+            uint32_t count = 0;
+            subdivideBezier(points, flatness, 10, [&](Point3 const&) { count++; });
+            pointOffset[i + 1] = count;
+        }
+    });
+    for (size_t i = 0; i < segments.size(); ++i) {
+        pointOffset[i + 1] += pointOffset[i];
+    }
+
+    // Each spline also ends with the end point of its last segment
+    spline.point.resize(pointOffset.back() + splineCount);
+    spline.pointOffset.resize(splineCount + 1);
+    for (size_t i = 0; i < splineCount; ++i) {
+        spline.pointOffset[i + 1] = pointOffset[splineSegments[i + 1]] + uint32_t(i + 1);
+    }
+    parallelFor(segments.size(), 256, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            size_t splineIndex = std::upper_bound(splineSegments.begin(), splineSegments.end(), uint32_t(i)) - splineSegments.begin() - 1;
+            Point3 points[4];
+            control(segments[i], points);
+            Point3* output = &spline.point[pointOffset[i] + splineIndex];
+            subdivideBezier(points, flatness, 10, [&](Point3 const& point) { *output++ = point; });
+        }
+    });
+    for (size_t i = 0; i < splineCount; ++i) {
+        uint32_t first = spline.knotOffset[i];
+        uint32_t last = spline.knotOffset[i + 1];
+        spline.point[spline.pointOffset[i + 1] - 1] = spline.knot[spline.closed[i] && last - first > 1 ? first : last - 1];
+    }
+}
+
+template <typename F>
+static void sweepRings(miMaxMesh& mesh, size_t ringCount, size_t ringSize, bool closed, uint16_t materialID, F&& function)
+{
+    // Quads between consecutive rings, a closed ring wraps around instead of repeating its first point
+    uint32_t base = uint32_t(mesh.vertex.size());
+    mesh.vertex.resize(base + ringCount * ringSize);
+    parallelFor(ringCount, 64, [&](size_t begin, size_t end) {
+        for (size_t ring = begin; ring < end; ++ring) {
+            for (size_t i = 0; i < ringSize; ++i) {
+                mesh.vertex[base + ring * ringSize + i] = function(ring, i);
+            }
+        }
+    });
+    size_t edgeCount = closed ? ringSize : ringSize - 1;
+    for (size_t ring = 0; ring + 1 < ringCount; ++ring) {
+        for (size_t i = 0; i < edgeCount; ++i) {
+            uint32_t a = uint32_t(base + ring * ringSize + i);
+            uint32_t b = uint32_t(base + ring * ringSize + (i + 1) % ringSize);
+            mesh.vertexArray.insert(mesh.vertexArray.end(), { a, b, uint32_t(b + ringSize), uint32_t(a + ringSize) });
+            mesh.faceOffset.push_back(uint32_t(mesh.vertexArray.size()));
+            mesh.smoothingGroup.push_back(0);
+            mesh.materialID.push_back(materialID);
+        }
+    }
+}
+
+static void extrudeSpline(miMaxMesh& mesh, float amount, int segments, bool capStart, bool capEnd)
+{
+    // Material IDs follow the defaults of the Extrude modifier : 0 start cap, 1 end cap, 2 sides
+    auto& spline = mesh.spline;
+    segments = std::max(segments, 1);
+    for (size_t i = 0; i + 1 < spline.pointOffset.size(); ++i) {
+        uint32_t begin = spline.pointOffset[i];
+        uint32_t end = spline.pointOffset[i + 1];
+        bool closed = spline.closed[i] && end - begin > 3;
+        size_t ringSize = closed ? end - begin - 1 : end - begin;
+        if (ringSize < 2)
+            continue;
+        uint32_t base = uint32_t(mesh.vertex.size());
+        sweepRings(mesh, segments + 1, ringSize, closed, 2, [&](size_t ring, size_t index) {
+            Point3 point = spline.point[begin + index];
+            point[2] += amount * float(ring) / float(segments);
+            return point;
+        });
+        if (closed == false)
+            continue;
+        auto cap = [&](uint32_t first, bool reverse, uint16_t materialID) {
+            for (size_t j = 0; j < ringSize; ++j) {
+                mesh.vertexArray.push_back(uint32_t(first + (reverse ? ringSize - 1 - j : j)));
+            }
+            mesh.faceOffset.push_back(uint32_t(mesh.vertexArray.size()));
+            mesh.smoothingGroup.push_back(0);
+            mesh.materialID.push_back(materialID);
+        };
+        if (capStart)
+            cap(base, amount >= 0.0f, 0);
+        if (capEnd)
+            cap(uint32_t(base + segments * ringSize), amount < 0.0f, 1);
+    }
+    static constexpr float pi = 3.14159265358979f;
+    smoothMesh(mesh, true, pi / 6.0f, 0);
+}
+
+static void getSkin(Context& context, Chunk const& chunk, Chunk const& modifierChunk, miMaxMesh& mesh)
+{
+    auto& scene = context.scene;
+    auto& skin = mesh.skin;
+
+    // Bones are referenced by the modifier itself, one bone every few references.
+    // A deleted bone leaves its references empty, so weights are mapped through the
+    // reference of the bone instead of the order of the remaining links.
+    std::vector<std::pair<uint32_t, uint32_t>> links;
+    for (auto [linkIndex, chunkIndex] : getLink(chunk)) {
+        if (scene.size() <= chunkIndex)
+            continue;
+        if (getClassData(context, scene[chunkIndex]).superClassID != BASENODE_SUPERCLASS_ID)
+            continue;
+        links.emplace_back(linkIndex, chunkIndex);
+    }
+    if (links.empty())
+        return;
+    uint32_t firstReference = links.front().first;
+    uint32_t stride = 0;
+    for (auto [linkIndex, chunkIndex] : links) {
+        stride = std::gcd(stride, linkIndex - firstReference);
+    }
+    stride = std::max(stride, 1u);
+
+    // Skin bone index to skin.bone, UINT32_MAX for deleted bones
+    std::vector<uint32_t> slots;
+    for (auto [linkIndex, chunkIndex] : links) {
+        uint32_t slot = (linkIndex - firstReference) / stride;
+        if (slot > UINT16_MAX) {
+            context.log("Skin bone %d is corrupted (%s)", linkIndex, getClassName(context, chunk).c_str());
+            continue;
+        }
+        if (slots.size() <= slot)
+            slots.resize(slot + 1, UINT32_MAX);
+        slots[slot] = uint32_t(skin.bone.size());
+
+        // Frame 0 transforms are composed up to the root
+        Matrix world = { 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0 };
+        for (uint32_t index = chunkIndex; index < context.parents.size(); index = context.parents[index]) {
+            miMaxNode pose;
+            auto* pTransform = getLinkChunk(scene, scene[index], 0);
+            if (pTransform) {
+                getPositionRotationScale(context, *pTransform, pose);
+            }
+            world = multiplyMatrix(localMatrix(pose), world);
+        }
+        skin.bone.push_back({ chunkIndex, linkIndex, world });
+    }
+    if (skin.bone.empty())
+        return;
+
+    // Vertex weights : vertexCount, { influenceCount, { bone, weight } * influenceCount } * vertexCount
+    // This layout is inferred, not documented. Data that does not parse exactly is skipped.
+    for (auto& child : modifierChunk) {
+        if (child.type != 0x2512)
+            continue;
+        for (auto& data : child) {
+            auto& property = data.property;
+            if (property.size() < sizeof(uint32_t))
+                continue;
+            uint32_t vertexCount = 0;
+            memcpy(&vertexCount, property.data(), sizeof(uint32_t));
+            if (vertexCount == 0 || vertexCount != mesh.vertex.size())
+                continue;
+            std::vector<uint32_t> offset(1);
+            std::vector<uint16_t> index;
+            std::vector<float> weight;
+            offset.reserve(vertexCount + 1);
+            size_t pos = sizeof(uint32_t);
+            bool corrupted = false;
+            for (uint32_t i = 0; i < vertexCount && corrupted == false; ++i) {
+                uint32_t count = 0;
+                if (pos + sizeof(uint32_t) > property.size()) {
+                    corrupted = true;
+                    break;
+                }
+                memcpy(&count, property.data() + pos, sizeof(uint32_t));
+                pos += sizeof(uint32_t);
+                if (count > slots.size() || pos + count * 8 > property.size()) {
+                    corrupted = true;
+                    break;
+                }
+                for (uint32_t j = 0; j < count; ++j) {
+                    uint32_t bone = 0;
+                    float value = 0.0f;
+                    memcpy(&bone, property.data() + pos + 0, sizeof(uint32_t));
+                    memcpy(&value, property.data() + pos + 4, sizeof(float));
+                    pos += 8;
+                    if (bone >= slots.size() || (value >= 0.0f && value <= 1.0f) == false) {
+                        corrupted = true;
+                        break;
+                    }
+                    if (value == 0.0f)
+                        continue;
+                    if (slots[bone] == UINT32_MAX) {
+                        corrupted = true;
+                        break;
+                    }
+                    index.push_back(uint16_t(slots[bone]));
+                    weight.push_back(value);
+                }
+                offset.push_back(uint32_t(index.size()));
+            }
+            if (corrupted || pos != property.size())
+                continue;
+            skin.weightOffset = std::move(offset);
+            skin.weightBone = std::move(index);
+            skin.weightValue = std::move(weight);
+            mesh.text += format("Skin : %zd (%zd)", skin.bone.size(), skin.weightValue.size()) + '\n';
+            return;
+        }
+    }
+    context.log("Skin weights are not found (%s)", getClassName(context, chunk).c_str());
+}
+
+static void getObjectSpaceModifier(Context& context, Chunk const& chunk, Chunk const& modifierChunk, miMaxMesh& mesh)
+{
+    auto& scene = context.scene;
+    if (getClassData(context, chunk).superClassID != OSM_SUPERCLASS_ID)
+        return;
+    auto* pParamBlock = getLinkChunk(scene, chunk, 0);
+    if (pParamBlock == nullptr)
+        return;
+    auto& paramBlock = getParamBlock(context, *pParamBlock);
+
+    // ????????-25215824-00000000-00000810  CLUSTOSM_CLASS_ID + OSM_SUPERCLASS_ID
+    // ????????-4AA52AE3-35CA1CDE-00000810  EDIT_NORMALS_CLASS_ID + OSM_SUPERCLASS_ID
+    // ????????-000F8613-00000000-00000810  SMOOTHOSM_CLASS_ID + OSM_SUPERCLASS_ID
+    // ????????-000F72B1-00000000-00000810  UVWMAPOSM_CLASS_ID + OSM_SUPERCLASS_ID
+    // ????????-7EBB4645-7BE2044B-00000810  PAINTLAYERMOD_CLASS_ID + OSM_SUPERCLASS_ID
+    // ????????-0095C723-00015666-00000810  SKIN_CLASS_ID + OSM_SUPERCLASS_ID
+    // ????????-00000100-00000000-00000810  MIRROROSM_CLASS_ID + OSM_SUPERCLASS_ID
+    // ????????-000000A0-00000000-00000810  EXTRUDEOSM_CLASS_ID + OSM_SUPERCLASS_ID
+    switch (class64(getClassData(context, chunk).classID)) {
+    case class64(CLUSTOSM_CLASS_ID): {
+        auto* pGizmo = getGizmo(context, chunk);
+        if (pGizmo == nullptr)
+            break;
+        miMaxNode gizmo;
+        getPositionRotationScale(context, *pGizmo, gizmo);
+        transformMesh(mesh, gizmo, getGizmoCenter(context, chunk));
+        mesh.text += format("Modifier : %s", "XForm") + '\n';
+        return;
+    }
+    case class64(EDIT_NORMALS_CLASS_ID): {
+        auto* pNormalChunk = getChunk(modifierChunk, 0x2512, 0x0240);
+        if (pNormalChunk == nullptr)
+            pNormalChunk = getChunk(modifierChunk, 0x2512, 0x0250);
+        if (pNormalChunk == nullptr)
+            break;
+        auto* pNormal = getChunk(*pNormalChunk, 0x0110);
+        if (pNormal == nullptr || pNormal->property.size() < sizeof(uint32_t) + sizeof(Point3))
+            break;
+        mesh.normal.resize((pNormal->property.size() - sizeof(uint32_t)) / sizeof(Point3));
+        memcpy(mesh.normal.data(), pNormal->property.data() + sizeof(uint32_t), mesh.normal.size() * sizeof(Point3));
+        mesh.text += format("Normal : %zd", mesh.normal.size()) + '\n';
+        break;
+    }
+    case class64(PAINTLAYERMOD_CLASS_ID):
+        if (paramBlock.size() > 1) {
+            auto* pColorChunk = getChunk(modifierChunk, 0x2512);
+            if (pColorChunk == nullptr)
+                break;
+            auto* pColor = getChunk(*pColorChunk, 0x0110);
+            if (pColor == nullptr)
+                break;
+
+            // -2 : Alpha, -1 : Illumination, 0 : Color
+            int index = std::clamp(paramBlock[1].get<int>(), -2, 0);
+            mesh.channelSources.erase(index);
+            auto& channel = mesh.channels[index];
+            size_t count = pColor->property.size() / sizeof(Point3);
+            channel.u.resize(count);
+            channel.v.resize(count);
+            channel.w.resize(count);
+            channel.index.clear();
+            for (size_t i = 0; i < count; ++i) {
+                Point3 color;
+                memcpy(&color, pColor->property.data() + i * sizeof(Point3), sizeof(Point3));
+                channel.u[i] = color[0];
+                channel.v[i] = color[1];
+                channel.w[i] = color[2];
+            }
+            static char const* const names[] = { "Vertex Alpha", "Vertex Illum", "Vertex Color" };
+            mesh.text += format("%s : %zd", names[index + 2], count) + '\n';
+            return;
+        }
+        break;
+    case class64(SKIN_CLASS_ID):
+        getSkin(context, chunk, modifierChunk, mesh);
+        return;
+    case class64(SMOOTHOSM_CLASS_ID):
+        if (paramBlock.size() > 3) {
+            bool autoSmooth = paramBlock[0].get<int>();
+            float threshold = paramBlock[2].get<float>();
+            uint32_t smoothingBits = paramBlock[3].get<uint32_t>();
+            smoothMesh(mesh, autoSmooth, threshold, smoothingBits);
+            mesh.text += format("Modifier : %s", "Smooth") + '\n';
+            return;
+        }
+        break;
+    case class64(UVWMAPOSM_CLASS_ID):
+        if (paramBlock.size() > 11) {
+            int type = paramBlock[0].get<int>();
+            Point3 tile = { paramBlock[1].get<float>(), paramBlock[2].get<float>(), paramBlock[3].get<float>() };
+            Point3 flip = { float(paramBlock[4].get<int>()), float(paramBlock[5].get<int>()), float(paramBlock[6].get<int>()) };
+            Point3 size = { paramBlock[9].get<float>(), paramBlock[10].get<float>(), paramBlock[11].get<float>() };
+            miMaxNode gizmo;
+            auto* pGizmo = getGizmo(context, chunk);
+            if (pGizmo) {
+                getPositionRotationScale(context, *pGizmo, gizmo);
+            }
+            uvwMapMesh(mesh, type, tile, flip, size, gizmo);
+            mesh.text += format("Modifier : %s", "UVW Map") + '\n';
+            return;
+        }
+        break;
+    case class64(MIRROROSM_CLASS_ID):
+        if (paramBlock.size() > 2) {
+            int axis = paramBlock[0].get<int>();
+            bool copy = paramBlock[1].get<int>();
+            float offset = paramBlock[2].get<float>();
+            miMaxNode gizmo;
+            auto* pGizmo = getGizmo(context, chunk);
+            if (pGizmo) {
+                getPositionRotationScale(context, *pGizmo, gizmo);
+            }
+            Point3 center = getGizmoCenter(context, chunk);
+            inverseTransformMesh(mesh, gizmo, center);
+            mirrorMesh(mesh, axis, copy, offset, center);
+            transformMesh(mesh, gizmo, center);
+            mesh.text += format("Modifier : %s", "Mirror") + '\n';
+            return;
+        }
+        break;
+    case class64(EXTRUDEOSM_CLASS_ID):
+        if (paramBlock.size() > 3) {
+            float amount = paramBlock[0].get<float>();
+            int segments = paramBlock[1].get<int>();
+            bool capStart = paramBlock[2].get<int>();
+            bool capEnd = paramBlock[3].get<int>();
+            extrudeSpline(mesh, amount, segments, capStart, capEnd);
+            mesh.text += format("Modifier : %s", "Extrude") + '\n';
+            return;
+        }
+        break;
+    default: {
+        // Class IDs of these modifiers differ between releases, so they are matched by name
+        auto className = getClassName(context, chunk);
+        if (className == "Symmetry" && paramBlock.size() > 4) {
+            int axis = paramBlock[0].get<int>();
+            bool flip = paramBlock[1].get<int>();
+            bool weld = paramBlock[3].get<int>();
+            float threshold = paramBlock[4].get<float>();
+            symmetryMesh(mesh, axis, flip, weld, threshold);
+            mesh.text += format("Modifier : %s", "Symmetry") + '\n';
+            return;
+        }
+        if (className == "Turn to Mesh") {
+            triangulateMesh(mesh);
+            mesh.text += format("Modifier : %s", "Turn to Mesh") + '\n';
+            return;
+        }
+        if (className == "Turn to Poly") {
+            polygonizeMesh(mesh);
+            mesh.text += format("Modifier : %s", "Turn to Poly") + '\n';
+            return;
+        }
+        checkClass(context, chunk, {}, 0);
+        break;
+    }
+    }
+}
+
+struct PatchData
+{
+    struct Patch
+    {
+        uint32_t type = 0;          // 3 : Triangle, 4 : Quad
+        uint32_t vertex[4] = {};
+        uint32_t vector[8] = {};    // Two handles per edge, the first one next to the start of the edge
+        uint32_t interior[4] = {};
+        uint32_t smoothingGroup = 0;
+        uint16_t materialID = 0;
+    };
+
+    struct Channel
+    {
+        std::vector<Point3> vertex;
+        std::vector<std::array<uint32_t, 4>> patch;
+    };
+
+    std::vector<Point3> vertex;
+    std::vector<Point3> vector;
+    std::vector<Patch> patches;
+    std::map<int, Channel> channels;
+};
+
+static void bernstein(float t, float weight[4])
+{
+    float s = 1.0f - t;
+    weight[0] = s * s * s;
+    weight[1] = 3.0f * s * s * t;
+    weight[2] = 3.0f * s * t * t;
+    weight[3] = t * t * t;
+}
+
+static void tessellatePatch(PatchData const& data, int steps, miMaxMesh& mesh)
+{
+    uint32_t n = uint32_t(std::clamp(steps, 0, 100) + 1);
+    uint32_t vertexCount = uint32_t(data.vertex.size());
+
+    // Edges are shared between patches, so their samples are evaluated once
+    struct Edge
+    {
+        uint32_t vertex[2];
+        uint32_t vector[2];
+    };
+    std::vector<Edge> edges;
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t> edgeIndices;
+    std::vector<std::array<uint32_t, 4>> patchEdges(data.patches.size());
+    std::vector<uint8_t> patchReversed(data.patches.size());
+    for (size_t p = 0; p < data.patches.size(); ++p) {
+        auto& patch = data.patches[p];
+        for (uint32_t e = 0; e < patch.type; ++e) {
+            uint32_t a = patch.vertex[e];
+            uint32_t b = patch.vertex[(e + 1) % patch.type];
+            auto [it, inserted] = edgeIndices.try_emplace({ std::min(a, b), std::max(a, b) }, uint32_t(edges.size()));
+            if (inserted)
+                edges.push_back({ { a, b }, { patch.vector[e * 2], patch.vector[e * 2 + 1] } });
+            patchEdges[p][e] = (*it).second;
+            if (edges[(*it).second].vertex[0] != a)
+                patchReversed[p] |= 1 << e;
+        }
+    }
+
+    // Sample slots of a patch : corner, edge or interior
+    struct Slot
+    {
+        uint8_t kind;       // 0 : Corner, 1 : Edge, 2 : Interior
+        uint8_t which;
+        uint32_t index;
+    };
+    std::vector<Slot> quadSlots((n + 1) * (n + 1));
+    std::vector<Slot> triangleSlots((n + 1) * (n + 1));
+    std::vector<float> quadWeights;
+    std::vector<float> triangleWeights;
+    uint32_t quadInterior = 0;
+    uint32_t triangleInterior = 0;
+    for (uint32_t j = 0; j <= n; ++j) {
+        for (uint32_t i = 0; i <= n; ++i) {
+            auto& slot = quadSlots[j * (n + 1) + i];
+            if ((i == 0 || i == n) && (j == 0 || j == n))   slot = { 0, uint8_t(j == 0 ? (i == 0 ? 0 : 1) : (i == n ? 2 : 3)), 0 };
+            else if (j == 0)                                slot = { 1, 0, i };
+            else if (i == n)                                slot = { 1, 1, j };
+            else if (j == n)                                slot = { 1, 2, n - i };
+            else if (i == 0)                                slot = { 1, 3, n - j };
+            else {
+                slot = { 2, 0, quadInterior++ };
+                float u[4];
+                float v[4];
+                bernstein(float(i) / n, u);
+                bernstein(float(j) / n, v);
+                for (int y = 0; y < 4; ++y) {
+                    for (int x = 0; x < 4; ++x) {
+                        quadWeights.push_back(u[x] * v[y]);
+                    }
+                }
+            }
+            if (i + j > n)
+                continue;
+            auto& triangle = triangleSlots[j * (n + 1) + i];
+            if (j == 0 && (i == 0 || i == n))               triangle = { 0, uint8_t(i == 0 ? 0 : 1), 0 };
+            else if (i == 0 && j == n)                      triangle = { 0, 2, 0 };
+            else if (j == 0)                                triangle = { 1, 0, i };
+            else if (i + j == n)                            triangle = { 1, 1, j };
+            else if (i == 0)                                triangle = { 1, 2, n - j };
+            else {
+                triangle = { 2, 0, triangleInterior++ };
+                float a = float(n - i - j) / n;
+                float b = float(i) / n;
+                float c = float(j) / n;
+                // b300 b030 b003 b210 b120 b021 b012 b102 b201 b111
+                float weight[10] = { a * a * a, b * b * b, c * c * c,
+                                     3 * a * a * b, 3 * a * b * b, 3 * b * b * c, 3 * b * c * c, 3 * c * c * a, 3 * c * a * a,
+                                     6 * a * b * c };
+                triangleWeights.insert(triangleWeights.end(), weight, weight + 10);
+            }
+        }
+    }
+
+    // Output ranges of each patch
+    size_t patchCount = data.patches.size();
+    std::vector<uint32_t> interiorOffset(patchCount + 1);
+    std::vector<uint32_t> faceOffset(patchCount + 1);
+    std::vector<uint32_t> cornerOffset(patchCount + 1);
+    std::vector<uint32_t> sampleOffset(patchCount + 1);
+    for (size_t p = 0; p < patchCount; ++p) {
+        bool quad = data.patches[p].type == 4;
+        interiorOffset[p + 1] = interiorOffset[p] + (quad ? quadInterior : triangleInterior);
+        faceOffset[p + 1] = faceOffset[p] + n * n;
+        cornerOffset[p + 1] = cornerOffset[p] + (quad ? n * n * 4 : n * n * 3);
+        sampleOffset[p + 1] = sampleOffset[p] + (quad ? (n + 1) * (n + 1) : (n + 1) * (n + 2) / 2);
+    }
+    uint32_t edgeBase = vertexCount;
+    uint32_t interiorBase = edgeBase + uint32_t(edges.size()) * (n - 1);
+    mesh.vertex.resize(interiorBase + interiorOffset.back());
+    std::copy(data.vertex.begin(), data.vertex.end(), mesh.vertex.begin());
+
+    // Edge curves
+    parallelFor(edges.size(), 1024, [&](size_t begin, size_t end) {
+        for (size_t e = begin; e < end; ++e) {
+            auto& edge = edges[e];
+            Point3 const* control[4] = { &data.vertex[edge.vertex[0]], &data.vector[edge.vector[0]], &data.vector[edge.vector[1]], &data.vertex[edge.vertex[1]] };
+            for (uint32_t s = 1; s < n; ++s) {
+                float weight[4];
+                bernstein(float(s) / n, weight);
+                Point3 point = {};
+                for (int k = 0; k < 4; ++k) {
+                    for (int c = 0; c < 3; ++c) {
+                        point[c] += weight[k] * (*control[k])[c];
+                    }
+                }
+                mesh.vertex[edgeBase + e * (n - 1) + s - 1] = point;
+            }
+        }
+    });
+
+    // Patch interiors and faces
+    size_t faceCount = faceOffset.back();
+    mesh.vertexArray.resize(cornerOffset.back());
+    mesh.faceOffset.resize(faceCount + 1);
+    mesh.smoothingGroup.resize(faceCount);
+    mesh.materialID.resize(faceCount);
+    std::vector<miMaxMesh::Channel*> channels;
+    std::vector<PatchData::Channel const*> channelData;
+    for (auto& [index, channel] : data.channels) {
+        auto& output = (*mesh.channels.try_emplace(index, mesh.vertexArray.get_allocator().resource()).first).second;
+        output.u.resize(sampleOffset.back());
+        output.v.resize(sampleOffset.back());
+        output.w.resize(sampleOffset.back());
+        output.index.resize(cornerOffset.back());
+        channels.push_back(&output);
+        channelData.push_back(&channel);
+    }
+    parallelFor(patchCount, 64, [&](size_t begin, size_t end) {
+        std::vector<uint32_t> grid((n + 1) * (n + 1));
+        std::vector<uint32_t> sample((n + 1) * (n + 1));
+        for (size_t p = begin; p < end; ++p) {
+            auto& patch = data.patches[p];
+            bool quad = patch.type == 4;
+            auto& slots = quad ? quadSlots : triangleSlots;
+            auto& weights = quad ? quadWeights : triangleWeights;
+            size_t controlCount = quad ? 16 : 10;
+
+            // Control points in SoA, so the weighted sums below vectorize
+            float control[3][16] = {};
+            auto set = [&](size_t k, Point3 const& point) {
+                control[0][k] = point[0];
+                control[1][k] = point[1];
+                control[2][k] = point[2];
+            };
+            auto& v = data.vertex;
+            auto& h = data.vector;
+            if (quad) {
+                Point3 const* grid4[16] = {
+                    &v[patch.vertex[0]],   &h[patch.vector[0]],   &h[patch.vector[1]],   &v[patch.vertex[1]],
+                    &h[patch.vector[7]],   &h[patch.interior[0]], &h[patch.interior[1]], &h[patch.vector[2]],
+                    &h[patch.vector[6]],   &h[patch.interior[3]], &h[patch.interior[2]], &h[patch.vector[3]],
+                    &v[patch.vertex[3]],   &h[patch.vector[5]],   &h[patch.vector[4]],   &v[patch.vertex[2]],
+                };
+                for (size_t k = 0; k < 16; ++k) {
+                    set(k, *grid4[k]);
+                }
+            }
+            else {
+                // A triangle patch keeps three interior handles, but the cubic Bezier triangle has
+                // a single center point b111, so their average stands in for it. This is an
+                // approximation, so the interior can differ slightly from the viewport.
+                Point3 center = {};
+                for (int k = 0; k < 3; ++k) {
+                    for (int c = 0; c < 3; ++c) {
+                        center[c] += h[patch.interior[k]][c] / 3.0f;
+                    }
+                }
+                Point3 const* net[10] = {
+                    &v[patch.vertex[0]], &v[patch.vertex[1]], &v[patch.vertex[2]],
+                    &h[patch.vector[0]], &h[patch.vector[1]], &h[patch.vector[2]], &h[patch.vector[3]], &h[patch.vector[4]], &h[patch.vector[5]],
+                    &center,
+                };
+                for (size_t k = 0; k < 10; ++k) {
+                    set(k, *net[k]);
+                }
+            }
+
+            // Global vertex of each sample
+            uint32_t sampleIndex = sampleOffset[p];
+            for (uint32_t j = 0; j <= n; ++j) {
+                for (uint32_t i = 0; i <= n; ++i) {
+                    if (quad == false && i + j > n)
+                        continue;
+                    auto& slot = slots[j * (n + 1) + i];
+                    uint32_t& index = grid[j * (n + 1) + i];
+                    switch (slot.kind) {
+                    case 0:
+                        index = patch.vertex[slot.which];
+                        break;
+                    case 1: {
+                        uint32_t s = (patchReversed[p] & (1 << slot.which)) ? n - slot.index : slot.index;
+                        index = edgeBase + patchEdges[p][slot.which] * (n - 1) + s - 1;
+                        break;
+                    }
+                    default: {
+                        index = interiorBase + interiorOffset[p] + slot.index;
+                        float const* weight = &weights[slot.index * controlCount];
+                        Point3 point = {};
+                        for (int c = 0; c < 3; ++c) {
+                            float sum = 0.0f;
+                            for (size_t k = 0; k < controlCount; ++k) {
+                                sum += weight[k] * control[c][k];
+                            }
+                            point[c] = sum;
+                        }
+                        mesh.vertex[index] = point;
+                        break;
+                    }
+                    }
+                    sample[j * (n + 1) + i] = sampleIndex;
+                    // Map values are blended linearly from the patch corners, bilinearly on quads and
+                    // barycentrically on triangles. This approximates the texture handles that are not decoded.
+                    for (size_t c = 0; c < channels.size(); ++c) {
+                        auto& tv = channelData[c]->vertex;
+                        auto& corners = channelData[c]->patch[p];
+                        float weight[4];
+                        if (quad) {
+                            float u = float(i) / n;
+                            float w = float(j) / n;
+                            weight[0] = (1 - u) * (1 - w);
+                            weight[1] = u * (1 - w);
+                            weight[2] = u * w;
+                            weight[3] = (1 - u) * w;
+                        }
+                        else {
+                            weight[0] = float(n - i - j) / n;
+                            weight[1] = float(i) / n;
+                            weight[2] = float(j) / n;
+                            weight[3] = 0.0f;
+                        }
+                        Point3 uvw = {};
+                        for (uint32_t k = 0; k < patch.type; ++k) {
+                            for (int e = 0; e < 3; ++e) {
+                                uvw[e] += weight[k] * tv[corners[k]][e];
+                            }
+                        }
+                        channels[c]->u[sampleIndex] = uvw[0];
+                        channels[c]->v[sampleIndex] = uvw[1];
+                        channels[c]->w[sampleIndex] = uvw[2];
+                    }
+                    sampleIndex++;
+                }
+            }
+
+            // Faces follow the winding of the patch
+            uint32_t face = faceOffset[p];
+            uint32_t corner = cornerOffset[p];
+            auto emit = [&](std::initializer_list<uint32_t> cells) {
+                for (uint32_t cell : cells) {
+                    mesh.vertexArray[corner] = grid[cell];
+                    for (size_t c = 0; c < channels.size(); ++c) {
+                        channels[c]->index[corner] = sample[cell];
+                    }
+                    corner++;
+                }
+                mesh.faceOffset[face + 1] = corner;
+                mesh.smoothingGroup[face] = patch.smoothingGroup;
+                mesh.materialID[face] = patch.materialID;
+                face++;
+            };
+            for (uint32_t j = 0; j < n; ++j) {
+                for (uint32_t i = 0; i < n; ++i) {
+                    uint32_t cell = j * (n + 1) + i;
+                    if (quad) {
+                        emit({ cell, cell + 1, cell + n + 2, cell + n + 1 });
+                        continue;
+                    }
+                    if (i + j < n)
+                        emit({ cell, cell + 1, cell + n + 1 });
+                    if (i + j + 1 < n)
+                        emit({ cell + 1, cell + n + 2, cell + n + 1 });
+                }
+            }
+        }
+    });
+}
+
+// Tessellation trusts the indices and the topology, so the decoder only runs on data that passes
+static bool checkPatchData(PatchData const& data, int steps)
+{
+    // Every index in range
+    for (auto& patch : data.patches) {
+        if (patch.type != 3 && patch.type != 4)
+            return false;
+        for (uint32_t k = 0; k < patch.type; ++k) {
+            if (patch.vertex[k] >= data.vertex.size() || patch.interior[k] >= data.vector.size())
+                return false;
+            if (patch.vector[k * 2] >= data.vector.size() || patch.vector[k * 2 + 1] >= data.vector.size())
+                return false;
+        }
+    }
+
+    // Edges join two different vertices and are shared by two patches at most
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t> edgeCount;
+    for (auto& patch : data.patches) {
+        for (uint32_t e = 0; e < patch.type; ++e) {
+            uint32_t a = patch.vertex[e];
+            uint32_t b = patch.vertex[(e + 1) % patch.type];
+            if (a == b || ++edgeCount[{ std::min(a, b), std::max(a, b) }] > 2)
+                return false;
+        }
+    }
+
+    // Output indices are 32-bit
+    uint64_t n = uint64_t(std::clamp(steps, 0, 100) + 1);
+    uint64_t corners = uint64_t(data.patches.size()) * n * n * 4;
+    uint64_t vertices = data.vertex.size() + edgeCount.size() * (n - 1) + data.patches.size() * (n + 1) * (n + 1);
+    return corners <= UINT32_MAX && vertices <= UINT32_MAX;
+}
+
+static bool getPatchData(Chunk const& patchChunk, PatchData& data)
+{
+    // Arrays start with their element count, a count past the data is corrupted
+    bool truncated = false;
+    auto count = [&](std::vector<uint32_t> const& array, size_t stride) {
+        if (array.empty())
+            return size_t(0);
+        truncated |= array[0] > (array.size() - 1) / stride;
+        return std::min<size_t>(array[0], (array.size() - 1) / stride);
+    };
+
+    auto vertex = getProperty<uint32_t>(patchChunk, 0x3002);
+    auto vector = getProperty<uint32_t>(patchChunk, 0x3003);
+    auto patches = getProperty<uint32_t>(patchChunk, 0x3004);
+    auto getPoint = [](std::vector<uint32_t> const& array, size_t offset) {
+        Point3 point;
+        memcpy(point.data(), &array[offset], sizeof(Point3));
+        return point;
+    };
+    for (size_t i = 0, size = count(vertex, 3); i < size; ++i) {
+        data.vertex.push_back(getPoint(vertex, 1 + i * 3));
+    }
+    for (size_t i = 0, size = count(vector, 3); i < size; ++i) {
+        data.vector.push_back(getPoint(vector, 1 + i * 3));
+    }
+    for (size_t i = 0, size = count(patches, 19); i < size; ++i) {
+        uint32_t const* source = &patches[1 + i * 19];
+        PatchData::Patch patch;
+        patch.type = source[0];
+        memcpy(patch.vertex, source + 1, sizeof(patch.vertex));
+        memcpy(patch.vector, source + 5, sizeof(patch.vector));
+        memcpy(patch.interior, source + 13, sizeof(patch.interior));
+        patch.smoothingGroup = source[17];
+        patch.materialID = uint16_t(source[18] >> 16);
+        data.patches.push_back(patch);
+    }
+    if (truncated)
+        return false;
+
+    // 0x3010 / 0x3011 / 0x3012 : Map channel / vertex / patch
+    int channel = 1;
+    for (auto& child : patchChunk) {
+        if (child.type == 0x3010 && child.property.size() >= sizeof(int)) {
+            memcpy(&channel, child.property.data(), sizeof(int));
+            continue;
+        }
+        if (child.type != 0x3011 && child.type != 0x3012)
+            continue;
+        if (channel < -2 || channel > 99)
+            continue;
+        std::vector<uint32_t> array(child.property.size() / sizeof(uint32_t));
+        memcpy(array.data(), child.property.data(), array.size() * sizeof(uint32_t));
+        auto& output = data.channels[channel];
+        if (child.type == 0x3011) {
+            for (size_t i = 0, size = count(array, 3); i < size; ++i) {
+                output.vertex.push_back(getPoint(array, 1 + i * 3));
+            }
+            continue;
+        }
+        for (size_t i = 0, size = count(array, 4); i < size; ++i) {
+            std::array<uint32_t, 4> corners;
+            memcpy(corners.data(), &array[1 + i * 4], sizeof(corners));
+            output.patch.push_back(corners);
+        }
+    }
+    for (auto it = data.channels.begin(); it != data.channels.end(); ) {
+        auto& output = (*it).second;
+        bool valid = output.patch.size() == data.patches.size();
+        for (size_t p = 0; valid && p < output.patch.size(); ++p) {
+            for (uint32_t k = 0; k < data.patches[p].type; ++k) {
+                valid &= output.patch[p][k] < output.vertex.size();
+            }
+        }
+        it = valid ? std::next(it) : data.channels.erase(it);
+    }
+
+    return true;
+}
+
+static void addSpline(miMaxSpline& spline, bool closed)
+{
+    spline.knotOffset.push_back(uint32_t(spline.knot.size()));
+    spline.closed.push_back(closed);
+}
+
+static void addKnot(miMaxSpline& spline, Point3 const& inTangent, Point3 const& knot, Point3 const& outTangent)
+{
+    spline.inTangent.push_back(inTangent);
+    spline.knot.push_back(knot);
+    spline.outTangent.push_back(outTangent);
+}
+
+static void addEllipse(miMaxSpline& spline, float width, float length)
+{
+    // Four knots with the usual quarter arc handle length
+    static constexpr float kappa = 0.5522847498f;
+    float x = width * 0.5f;
+    float y = length * 0.5f;
+    addKnot(spline, {  x, -y * kappa, 0 }, {  x,  0, 0 }, {  x,  y * kappa, 0 });
+    addKnot(spline, {  x * kappa,  y, 0 }, {  0,  y, 0 }, { -x * kappa,  y, 0 });
+    addKnot(spline, { -x,  y * kappa, 0 }, { -x,  0, 0 }, { -x, -y * kappa, 0 });
+    addKnot(spline, { -x * kappa, -y, 0 }, {  0, -y, 0 }, {  x * kappa, -y, 0 });
+    addSpline(spline, true);
+}
+
+static void addRectangle(miMaxSpline& spline, float width, float length, float fillet)
+{
+    static constexpr float kappa = 0.5522847498f;
+    float x = width * 0.5f;
+    float y = length * 0.5f;
+    fillet = std::clamp(fillet, 0.0f, std::min(x, y));
+    Point3 const corners[4] = { { x, -y, 0 }, { x, y, 0 }, { -x, y, 0 }, { -x, -y, 0 } };
+    auto lerp = [](Point3 const& a, Point3 const& b, float t) {
+        return Point3{ a[0] + (b[0] - a[0]) * t, a[1] + (b[1] - a[1]) * t, a[2] + (b[2] - a[2]) * t };
+    };
+    auto toward = [&](Point3 const& from, Point3 const& to, float distance) {
+        float length = fabsf(to[0] - from[0]) + fabsf(to[1] - from[1]);
+        return lerp(from, to, length > 0.0f ? distance / length : 0.0f);
+    };
+
+    // Straight edges keep their handles at thirds, fillets are quarter arcs around the corner
+    std::vector<Point3> points;
+    for (int i = 0; i < 4; ++i) {
+        auto& previous = corners[(i + 3) % 4];
+        auto& corner = corners[i];
+        auto& next = corners[(i + 1) % 4];
+        if (fillet > 0.0f) {
+            points.push_back(toward(corner, previous, fillet));
+            points.push_back(toward(corner, next, fillet));
+        }
+        else {
+            points.push_back(corner);
+        }
+    }
+    size_t count = points.size();
+    for (size_t i = 0; i < count; ++i) {
+        auto& previous = points[(i + count - 1) % count];
+        auto& point = points[i];
+        auto& next = points[(i + 1) % count];
+        Point3 inTangent = lerp(point, previous, 1.0f / 3.0f);
+        Point3 outTangent = lerp(point, next, 1.0f / 3.0f);
+        if (fillet > 0.0f) {
+            auto& corner = corners[i / 2];
+            if (i % 2 == 0)
+                outTangent = lerp(point, corner, kappa);
+            else
+                inTangent = lerp(point, corner, kappa);
+        }
+        addKnot(spline, inTangent, point, outTangent);
+    }
+    addSpline(spline, true);
+}
+
+static bool getShapeData(Chunk const& shapeChunk, miMaxSpline& spline)
+{
+    // This layout is inferred from saved files, not documented
+    // 0x2910 : Spline
+    //   0x2911 : Closed
+    //   0x2912 : Knots { type, in tangent, knot, out tangent }
+    struct Knot
+    {
+        uint32_t type;
+        Point3 inTangent;
+        Point3 knot;
+        Point3 outTangent;
+    };
+    for (auto& splineChunk : shapeChunk) {
+        if (splineChunk.type != 0x2910)
+            continue;
+        auto closed = getProperty<uint32_t>(splineChunk, 0x2911);
+        auto* pKnots = getChunk(splineChunk, 0x2912);
+        if (pKnots == nullptr || pKnots->property.size() % sizeof(Knot))
+            return false;
+        size_t count = pKnots->property.size() / sizeof(Knot);
+        if (count == 0)
+            continue;
+        for (size_t i = 0; i < count; ++i) {
+            Knot knot;
+            memcpy(&knot, pKnots->property.data() + i * sizeof(Knot), sizeof(Knot));
+            addKnot(spline, knot.inTangent, knot.knot, knot.outTangent);
+        }
+        addSpline(spline, closed.empty() == false && closed[0] != 0);
+    }
+    return true;
+}
+
+static void getShape(Context& context, Chunk const& chunk, miMaxMesh& mesh)
+{
+    auto log = context.log;
+    auto& spline = mesh.spline;
+    auto* pParamBlock = getLinkChunk(context.scene, chunk, 0);
+    auto const* paramBlock = pParamBlock ? &getParamBlock(context, *pParamBlock) : nullptr;
+    auto className = getClassName(context, chunk);
+
+    // ????????-0000000a-00000000-00000040 Editable Spline  SPLINESHAPE_CLASS_ID + SHAPE_SUPERCLASS_ID
+    // ????????-00000010-00000000-00000040 Line             SPLINE3D_CLASS_ID + SHAPE_SUPERCLASS_ID
+    // ????????-00000025-00000000-00000040 Circle           CIRCLE_CLASS_ID + SHAPE_SUPERCLASS_ID
+    // ????????-00000029-00000000-00000040 Rectangle        RECTANGLE_CLASS_ID + SHAPE_SUPERCLASS_ID
+    switch (class64(getClassData(context, chunk).classID)) {
+    case class64(SPLINESHAPE_CLASS_ID):
+    case class64(SPLINE3D_CLASS_ID): {
+        auto* pShapeChunk = getChunk(chunk, 0x2900);
+        if (pShapeChunk == nullptr)
+            return;
+        if (getShapeData(*pShapeChunk, spline) == false) {
+            log("%s is corrupted", className.c_str());
+            return;
+        }
+        break;
+    }
+    case class64(CIRCLE_CLASS_ID):
+        if (paramBlock && paramBlock->size() > 0) {
+            float radius = (*paramBlock)[0].get<float>();
+            addEllipse(spline, radius * 2.0f, radius * 2.0f);
+            break;
+        }
+        return;
+    case class64(RECTANGLE_CLASS_ID):
+        if (paramBlock && paramBlock->size() > 2) {
+            float length = (*paramBlock)[0].get<float>();
+            float width = (*paramBlock)[1].get<float>();
+            float fillet = (*paramBlock)[2].get<float>();
+            addRectangle(spline, width, length, fillet);
+            break;
+        }
+        return;
+    default:
+        checkClass(context, chunk, {}, 0);
+        return;
+    }
+    sampleSpline(spline, context.splineFlatness);
+
+    mesh.text += format("Shape : %s", className.c_str()) + '\n';
+    mesh.text += format("Spline : %zd", spline.knotOffset.size() - 1) + '\n';
+    mesh.text += format("Knot : %zd", spline.knot.size()) + '\n';
+    mesh.text += format("Point : %zd", spline.point.size()) + '\n';
+}
+
+static void getPrimitive(Context& context, Chunk const& chunk, miMaxMesh& mesh)
+{
+    auto log = context.log;
+    auto& scene = context.scene;
+    auto* pChunk = &chunk;
+    if (getClassData(context, *pChunk).superClassID == SHAPE_SUPERCLASS_ID) {
+        getShape(context, *pChunk, mesh);
+        return;
+    }
+    if (getClassData(context, *pChunk).superClassID != GEOMOBJECT_SUPERCLASS_ID) {
+        if ((*pChunk).type != 0x2032)
+            return;
+        auto link = getLink<std::greater<uint32_t>>(*pChunk);
+        for (auto [linkIndex, chunkIndex] : link) {
+            if (scene.size() <= chunkIndex)
+                continue;
+            auto& chunk = scene[chunkIndex];
+            if (pChunk == &chunk)
+                continue;
+            if (getClassData(context, chunk).superClassID == OSM_SUPERCLASS_ID) {
+                size_t index = 0;
+                Chunk const* pModifierChunk = nullptr;
+                for (auto& child : (*pChunk)) {
+                    if (child.type == 0x2500) {
+                        if (index == linkIndex) {
+                            pModifierChunk = &child;
+                            break;
+                        }
+                        index++;
+                    }
+                }
+                if (pModifierChunk == nullptr)
+                    continue;
+                getObjectSpaceModifier(context, chunk, *pModifierChunk, mesh);
+                continue;
+            }
+            getPrimitive(context, chunk, mesh);
+        }
+        return;
+    }
+    auto* pParamBlock = getLinkChunk(scene, *pChunk, 0);
+    if (pParamBlock == nullptr)
+        return;
+    auto& paramBlock = getParamBlock(context, *pParamBlock);
+
+    // ????????-00000010-00000000-00000010 Box              BOXOBJ_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
+    // ????????-00000011-00000000-00000010 Sphere           SPHERE_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
+    // ????????-00000012-00000000-00000010 Cylinder         CYLINDER_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
+    // ????????-00000020-00000000-00000010 Torus            TORUS_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
+    // ????????-a86c23dd-00000000-00000010 Cone             CONE_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
+    // ????????-00000000-00007f9e-00000010 GeoSphere        GSPHERE_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
+    // ????????-00007b21-00000000-00000010 Tube             TUBE_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
+    // ????????-76bf318a-4bf37b10-00000010 Pyramid          PYRAMID_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
     // ????????-081f1dfc-77566f65-00000010 Plane            PLANE_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
     // ????????-e44f10b3-00000000-00000010 Editable Mesh    EDITTRIOBJ_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
     // ????????-1bf8338d-192f6098-00000010 Editable Poly    EPOLYOBJ_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
-    switch (class64((*pChunk).classData.classID)) {
+    // ????????-00001030-00000000-00000010 Editable Patch   PATCHOBJ_CLASS_ID + GEOMOBJECT_SUPERCLASS_ID
+    switch (class64(getClassData(context, *pChunk).classID)) {
     case class64(BOXOBJ_CLASS_ID):
         if (paramBlock.size() > 5) {
-            float length = std::get<float>(paramBlock[0]);
-            float width = std::get<float>(paramBlock[1]);
-            float height = std::get<float>(paramBlock[2]);
-            int lengthSegments = std::get<int>(paramBlock[3]);
-            int widthSegments = std::get<int>(paramBlock[4]);
-            int heightSegments = std::get<int>(paramBlock[5]);
-
-            node.vertex = {
+            float length = paramBlock[0].get<float>();
+            float width = paramBlock[1].get<float>();
+            float height = paramBlock[2].get<float>();
+            int lengthSegments = paramBlock[3].get<int>();
+            int widthSegments = paramBlock[4].get<int>();
+            int heightSegments = paramBlock[5].get<int>();
+
+            mesh.vertex = {
                 { -length, -width, -height },
                 {  length, -width, -height },
                 { -length,  width, -height },
@@ -580,402 +3147,2407 @@ static void getPrimitive(int(*log)(char const*, ...), Chunk const& scene, Chunk
                 {  length,  width,  height },
             };
 
-            node.text += format("Primitive : %s", "Box") + '\n';
-            node.text += format("Length : %f", length) + '\n';
-            node.text += format("Width : %f", width) + '\n';
-            node.text += format("Height : %f", height) + '\n';
-            node.text += format("Length Segments : %d", lengthSegments) + '\n';
-            node.text += format("Width Segments : %d", widthSegments) + '\n';
-            node.text += format("Height Segments : %d", heightSegments) + '\n';
-            return;
+            mesh.text += format("Primitive : %s", "Box") + '\n';
+            mesh.text += format("Length : %f", length) + '\n';
+            mesh.text += format("Width : %f", width) + '\n';
+            mesh.text += format("Height : %f", height) + '\n';
+            mesh.text += format("Length Segments : %d", lengthSegments) + '\n';
+            mesh.text += format("Width Segments : %d", widthSegments) + '\n';
+            mesh.text += format("Height Segments : %d", heightSegments) + '\n';
+            return;
+        }
+        checkClass(context, *pParamBlock, {}, 0);
+        break;
+    case class64(SPHERE_CLASS_ID):
+        if (paramBlock.size() > 4) {
+            float radius = paramBlock[0].get<float>();
+            int segments = paramBlock[1].get<int>();
+            bool smooth = paramBlock[2].get<int>();
+            float hemisphere = paramBlock[3].get<float>();
+            int chopSquash = paramBlock[4].get<int>();
+
+            mesh.text += format("Primitive : %s", "Sphere") + '\n';
+            mesh.text += format("Radius : %f", radius) + '\n';
+            mesh.text += format("Segments : %d", segments) + '\n';
+            mesh.text += format("Smooth : %s", smooth ? "true" : "false") + '\n';
+            mesh.text += format("Hemisphere : %f", hemisphere) + '\n';
+            mesh.text += format("ChopSquash : %s", chopSquash == 0 ? "Chop" : "Squash") + '\n';
+            return;
+        }
+        checkClass(context, *pParamBlock, {}, 0);
+        break;
+    case class64(CYLINDER_CLASS_ID):
+        if (paramBlock.size() > 5) {
+            float radius = paramBlock[0].get<float>();
+            float height = paramBlock[1].get<float>();
+            int heightSegments = paramBlock[2].get<int>();
+            int capSegments = paramBlock[3].get<int>();
+            int sides = paramBlock[4].get<int>();
+            bool smooth = paramBlock[5].get<int>();
+
+            mesh.text += format("Primitive : %s", "Cylinder") + '\n';
+            mesh.text += format("Radius : %f", radius) + '\n';
+            mesh.text += format("Height : %f", height) + '\n';
+            mesh.text += format("Height Segments : %d", heightSegments) + '\n';
+            mesh.text += format("Cap Segments : %d", capSegments) + '\n';
+            mesh.text += format("Sides : %d", sides) + '\n';
+            mesh.text += format("Smooth : %s", smooth ? "true" : "false") + '\n';
+            return;
+        }
+        checkClass(context, *pParamBlock, {}, 0);
+        break;
+    case class64(TORUS_CLASS_ID):
+        if (paramBlock.size() > 6) {
+            float radius1 = paramBlock[0].get<float>();
+            float radius2 = paramBlock[1].get<float>();
+            float rotation = paramBlock[2].get<float>();
+            float twist = paramBlock[3].get<float>();
+            int segments = paramBlock[4].get<int>();
+            int sides = paramBlock[5].get<int>();
+            int smooth = paramBlock[6].get<int>();
+
+            mesh.text += format("Primitive : %s", "Torus") + '\n';
+            mesh.text += format("Radius1 : %f", radius1) + '\n';
+            mesh.text += format("Radius2 : %f", radius2) + '\n';
+            mesh.text += format("Rotation : %f", rotation) + '\n';
+            mesh.text += format("Twist : %f", twist) + '\n';
+            mesh.text += format("Segments : %d", segments) + '\n';
+            mesh.text += format("Sides : %d", sides) + '\n';
+            mesh.text += format("Smooth : %d", smooth) + '\n';
+            return;
+        }
+        checkClass(context, *pParamBlock, {}, 0);
+        break;
+    case class64(CONE_CLASS_ID):
+        if (paramBlock.size() > 6) {
+            float radius1 = paramBlock[0].get<float>();
+            float radius2 = paramBlock[1].get<float>();
+            float height = paramBlock[2].get<float>();
+            int heightSegments = paramBlock[3].get<int>();
+            int capSegments = paramBlock[4].get<int>();
+            int sides = paramBlock[5].get<int>();
+            bool smooth = paramBlock[6].get<int>();
+
+            mesh.text += format("Primitive : %s", "Cone") + '\n';
+            mesh.text += format("Radius1 : %f", radius1) + '\n';
+            mesh.text += format("Radius2 : %f", radius2) + '\n';
+            mesh.text += format("Height : %f", height) + '\n';
+            mesh.text += format("Height Segments : %d", heightSegments) + '\n';
+            mesh.text += format("Cap Segments : %d", capSegments) + '\n';
+            mesh.text += format("Sides : %d", sides) + '\n';
+            mesh.text += format("Smooth : %s", smooth ? "true" : "false") + '\n';
+            return;
+        }
+        checkClass(context, *pParamBlock, {}, 0);
+        break;
+    case class64(GSPHERE_CLASS_ID):
+        if (paramBlock.size() > 4) {
+            float radius = paramBlock[0].get<float>();
+            int segments = paramBlock[1].get<int>();
+            int geodesicBaseType = paramBlock[2].get<int>();
+            bool smooth = paramBlock[3].get<int>();
+            bool hemisphere = paramBlock[4].get<int>();
+
+            mesh.text += format("Primitive : %s", "GeoSphere") + '\n';
+            mesh.text += format("Radius : %f", radius) + '\n';
+            mesh.text += format("Segments : %d", segments) + '\n';
+            mesh.text += format("Geodesic Base Type : %d", geodesicBaseType) + '\n';
+            mesh.text += format("Smooth : %f", smooth ? "true" : "false") + '\n';
+            mesh.text += format("Hemisphere : %f", hemisphere ? "true" : "false") + '\n';
+            return;
+        }
+        checkClass(context, *pParamBlock, {}, 0);
+        break;
+    case class64(TUBE_CLASS_ID):
+        if (paramBlock.size() > 6) {
+            float radius1 = paramBlock[0].get<float>();
+            float radius2 = paramBlock[1].get<float>();
+            float height = paramBlock[2].get<float>();
+            int heightSegments = paramBlock[3].get<int>();
+            int capSegments = paramBlock[4].get<int>();
+            int sides = paramBlock[5].get<int>();
+            bool smooth = paramBlock[6].get<int>();
+
+            mesh.text += format("Primitive : %s", "Tube") + '\n';
+            mesh.text += format("Radius1 : %f", radius1) + '\n';
+            mesh.text += format("Radius2 : %f", radius2) + '\n';
+            mesh.text += format("Height : %f", height) + '\n';
+            mesh.text += format("Height Segments : %d", heightSegments) + '\n';
+            mesh.text += format("Cap Segments : %d", capSegments) + '\n';
+            mesh.text += format("Sides : %d", sides) + '\n';
+            mesh.text += format("Smooth : %s", smooth ? "true" : "false") + '\n';
+            return;
+        }
+        checkClass(context, *pParamBlock, {}, 0);
+        break;
+    case class64(PYRAMID_CLASS_ID):
+        if (paramBlock.size() > 5) {
+            float width = paramBlock[0].get<float>();
+            float depth = paramBlock[1].get<float>();
+            float height = paramBlock[2].get<float>();
+            int widthSegments = paramBlock[3].get<int>();
+            int depthSegments = paramBlock[4].get<int>();
+            int heightSegments = paramBlock[5].get<int>();
+
+            mesh.text += format("Primitive : %s", "Pyramid") + '\n';
+            mesh.text += format("Width : %f", width) + '\n';
+            mesh.text += format("Depth : %f", depth) + '\n';
+            mesh.text += format("Height : %f", height) + '\n';
+            mesh.text += format("Width Segments : %d", widthSegments) + '\n';
+            mesh.text += format("Depth Segments : %d", depthSegments) + '\n';
+            mesh.text += format("Height Segments : %d", heightSegments) + '\n';
+            return;
+        }
+        checkClass(context, *pParamBlock, {}, 0);
+        break;
+    case class64(PLANE_CLASS_ID):
+        if (paramBlock.size() > 3) {
+            float length = paramBlock[0].get<float>();
+            float width = paramBlock[1].get<float>();
+            int lengthSegments = paramBlock[2].get<int>();
+            int widthSegments = paramBlock[3].get<int>();
+
+            mesh.vertex = {
+                { -length, -width, 0 },
+                {  length, -width, 0 },
+                { -length,  width, 0 },
+                {  length,  width, 0 },
+            };
+
+            mesh.text += format("Primitive : %s", "Plane") + '\n';
+            mesh.text += format("Length : %f", length) + '\n';
+            mesh.text += format("Width : %f", width) + '\n';
+            mesh.text += format("Length Segments : %d", lengthSegments) + '\n';
+            mesh.text += format("Width Segments : %d", widthSegments) + '\n';
+            return;
+        }
+        checkClass(context, *pParamBlock, {}, 0);
+        break;
+    case class64(EDITTRIOBJ_CLASS_ID): {
+        auto* pPolyChunk = getChunk(*pChunk, 0x08FE);
+        if (pPolyChunk == nullptr)
+            break;
+        auto& polyChunk = (*pPolyChunk);
+
+        auto vertexArray = getProperty<int>(polyChunk, 0x0912);
+        mesh.vertexArray.reserve(vertexArray.size() / 5 * 3);
+        mesh.faceOffset.reserve(vertexArray.size() / 5 + 1);
+        mesh.smoothingGroup.reserve(vertexArray.size() / 5);
+        mesh.materialID.reserve(vertexArray.size() / 5);
+        for (size_t i = 1; i + 4 < vertexArray.size(); i += 5) {
+            mesh.vertexArray.push_back(vertexArray[i]);
+            mesh.vertexArray.push_back(vertexArray[i + 1]);
+            mesh.vertexArray.push_back(vertexArray[i + 2]);
+            mesh.faceOffset.push_back(uint32_t(mesh.vertexArray.size()));
+            mesh.smoothingGroup.push_back(vertexArray[i + 3]);
+            mesh.materialID.push_back(uint16_t(uint32_t(vertexArray[i + 4]) >> 16));
+        }
+
+        auto vertex = getProperty<float>(polyChunk, 0x0914);
+        mesh.vertex.reserve(vertex.size() / 3);
+        for (size_t i = 1; i + 2 < vertex.size(); i += 3) {
+            mesh.vertex.push_back({vertex[i], vertex[i + 1], vertex[i + 2]});
+        }
+
+        // 0x0916 / 0x0918 : Texture vertex / face
+        // 0x2392 / 0x2394 / 0x2396 : Map channel / vertex / face
+        addChannelSources(mesh, polyChunk, 0xFFFF, 0x0916, 0x0918, false);
+        addChannelSources(mesh, polyChunk, 0x2392, 0x2394, 0x2396, false);
+        checkChannelSources(log, mesh, "Editable Mesh");
+
+        mesh.text += format("Primitive : %s", "Editable Mesh") + '\n';
+        mesh.text += format("Vertex : %zd", mesh.vertex.size()) + '\n';
+        mesh.text += format("Vertex Array : %zd (%zd)", mesh.faceOffset.size() - 1, mesh.vertexArray.size()) + '\n';
+        mesh.text += format("Map Channel : %s", getChannelText(mesh).c_str()) + '\n';
+        return;
+    }
+    case class64(EPOLYOBJ_CLASS_ID): {
+        auto* pPolyChunk = getChunk(*pChunk, 0x08FE);
+        if (pPolyChunk == nullptr)
+            break;
+        auto& polyChunk = (*pPolyChunk);
+
+        auto vertex = getProperty<float>(polyChunk, 0x0100);
+        mesh.vertex.reserve(vertex.size() / 4);
+        for (size_t i = 1; i + 3 < vertex.size(); i += 4) {
+            mesh.vertex.push_back({vertex[i + 1], vertex[i + 2], vertex[i + 3]});
+        }
+
+        auto vertexArray = getProperty<uint16_t>(polyChunk, 0x011A);
+        for (size_t i = 2; i + 1 < vertexArray.size(); i += 2) {
+            uint32_t count = (vertexArray[i] | vertexArray[i + 1] << 16) * 2;
+            if (i + 2 + count + 1 > vertexArray.size()) {
+                log("%s is corrupted", "Editable Poly");
+                break;
+            }
+            i += 2;
+            for (size_t j = i, list = i + count; j < list; j += 2) {
+                mesh.vertexArray.push_back(vertexArray[j] | vertexArray[j + 1] << 16);
+            }
+            mesh.faceOffset.push_back(uint32_t(mesh.vertexArray.size()));
+            i += count;
+            uint16_t flags = vertexArray[i];
+            uint16_t materialID = 0;
+            uint32_t smoothingGroup = 0;
+            i += 1;
+            if (flags & 0x01)   i += 2;
+            if (flags & 0x08) { materialID = vertexArray[i];                                i += 1; }
+            if (flags & 0x10) { smoothingGroup = vertexArray[i] | vertexArray[i + 1] << 16; i += 2; }
+            if (flags & 0x20)   i += 2 * (count - 6);
+            i -= 2;
+            mesh.materialID.push_back(materialID);
+            mesh.smoothingGroup.push_back(smoothingGroup);
+        }
+
+        // 0x0124 / 0x0128 / 0x012B : Map channel / vertex / face
+        addChannelSources(mesh, polyChunk, 0x0124, 0x0128, 0x012B, true);
+        checkChannelSources(log, mesh, "Editable Poly");
+
+        mesh.text += format("Primitive : %s", "Editable Poly") + '\n';
+        mesh.text += format("Vertex : %zd", mesh.vertex.size()) + '\n';
+        mesh.text += format("Vertex Array : %zd (%zd)", mesh.faceOffset.size() - 1, mesh.vertexArray.size()) + '\n';
+        mesh.text += format("Map Channel : %s", getChannelText(mesh).c_str()) + '\n';
+        return;
+    }
+    case class64(PATCHOBJ_CLASS_ID): {
+        auto* pPatchChunk = getChunk(*pChunk, 0x3001);
+        if (pPatchChunk == nullptr)
+            break;
+
+        PatchData data;
+        if (getPatchData(*pPatchChunk, data) == false || checkPatchData(data, context.patchSteps) == false) {
+            log("%s is corrupted", "Editable Patch");
+            break;
+        }
+        tessellatePatch(data, context.patchSteps, mesh);
+
+        mesh.text += format("Primitive : %s", "Editable Patch") + '\n';
+        mesh.text += format("Patch : %zd (%zd, %zd)", data.patches.size(), data.vertex.size(), data.vector.size()) + '\n';
+        mesh.text += format("Steps : %d", context.patchSteps) + '\n';
+        mesh.text += format("Vertex : %zd", mesh.vertex.size()) + '\n';
+        mesh.text += format("Vertex Array : %zd (%zd)", mesh.faceOffset.size() - 1, mesh.vertexArray.size()) + '\n';
+        mesh.text += format("Map Channel : %s", getChannelText(mesh).c_str()) + '\n';
+        return;
+    }
+    default:
+        break;
+    }
+    checkClass(context, *pChunk, {}, 0);
+}
+
+static void sortMaterial(miMaxMesh& mesh)
+{
+    size_t faceCount = mesh.faceOffset.size() - 1;
+    if (mesh.materialID.size() != faceCount)
+        mesh.materialID.assign(faceCount, 0);
+    if (faceCount == 0)
+        return;
+    if (std::all_of(mesh.materialID.begin(), mesh.materialID.end(), [&](uint16_t id) { return id == mesh.materialID.front(); })) {
+        mesh.materialRange.push_back({ mesh.materialID.front(), 0, uint32_t(faceCount) });
+        return;
+    }
+
+    // Counting sort by material ID
+    std::vector<uint32_t> cursor(UINT16_MAX + 1);
+    for (uint16_t materialID : mesh.materialID) {
+        cursor[materialID]++;
+    }
+    uint32_t faceBegin = 0;
+    for (uint32_t i = 0; i <= UINT16_MAX; ++i) {
+        uint32_t count = cursor[i];
+        if (count == 0)
+            continue;
+        mesh.materialRange.push_back({ uint16_t(i), faceBegin, count });
+        cursor[i] = faceBegin;
+        faceBegin += count;
+    }
+    if (mesh.materialRange.size() <= 1)
+        return;
+
+    std::vector<uint32_t> faceOrder(faceCount);
+    for (uint32_t i = 0; i < faceCount; ++i) {
+        faceOrder[cursor[mesh.materialID[i]]++] = i;
+    }
+
+    auto* resource = mesh.vertexArray.get_allocator().resource();
+    std::pmr::vector<uint32_t> faceOffset(faceCount + 1, 0, resource);
+    for (size_t i = 0; i < faceCount; ++i) {
+        uint32_t face = faceOrder[i];
+        faceOffset[i + 1] = faceOffset[i] + mesh.faceOffset[face + 1] - mesh.faceOffset[face];
+    }
+    auto reorder = [&](auto& array) {
+        std::decay_t<decltype(array)> output(array.size(), array.get_allocator());
+        parallelFor(faceCount, 16384, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                uint32_t face = faceOrder[i];
+                std::copy(array.begin() + mesh.faceOffset[face], array.begin() + mesh.faceOffset[face + 1], output.begin() + faceOffset[i]);
+            }
+        });
+        array = std::move(output);
+    };
+    // Explicit normals by corner follow their faces
+    if (mesh.normal.size() == mesh.vertexArray.size() && mesh.normal.size() != mesh.vertex.size()) {
+        reorder(mesh.normal);
+    }
+    reorder(mesh.vertexArray);
+    for (auto& [index, channel] : mesh.channels) {
+        if (channel.index.size() == mesh.vertexArray.size()) {
+            reorder(channel.index);
+        }
+    }
+    std::pmr::vector<uint16_t> materialID(faceCount, 0, resource);
+    std::pmr::vector<uint32_t> smoothingGroup(mesh.smoothingGroup.size() == faceCount ? faceCount : 0, 0, resource);
+    for (size_t i = 0; i < faceCount; ++i) {
+        materialID[i] = mesh.materialID[faceOrder[i]];
+        if (smoothingGroup.empty() == false)
+            smoothingGroup[i] = mesh.smoothingGroup[faceOrder[i]];
+    }
+    mesh.faceOffset = std::move(faceOffset);
+    mesh.materialID = std::move(materialID);
+    if (smoothingGroup.empty() == false)
+        mesh.smoothingGroup = std::move(smoothingGroup);
+    if (mesh.channelSources.empty() == false)
+        mesh.faceOrder = std::move(faceOrder);
+}
+
+static void generateNormal(miMaxMesh& mesh)
+{
+    size_t faceCount = mesh.faceOffset.size() - 1;
+    size_t cornerCount = mesh.vertexArray.size();
+    size_t vertexCount = mesh.vertex.size();
+
+    // Explicit normals
+    if (mesh.normal.empty() == false) {
+        if (mesh.normal.size() == vertexCount) {
+            mesh.normalIndex = mesh.vertexArray;
+        }
+        else if (mesh.normal.size() == cornerCount) {
+            mesh.normalIndex.resize(cornerCount);
+            for (uint32_t i = 0; i < cornerCount; ++i) {
+                mesh.normalIndex[i] = i;
+            }
+        }
+        return;
+    }
+    if (faceCount == 0 || vertexCount == 0)
+        return;
+    if (std::any_of(mesh.vertexArray.begin(), mesh.vertexArray.end(), [&](uint32_t index) { return index >= vertexCount; }))
+        return;
+
+    // Area weighted face normals
+    auto* scratch = getScratch();
+    std::pmr::vector<Point3> faceNormals(faceCount, scratch);
+    parallelFor(faceCount, 4096, [&](size_t begin, size_t end) {
+        for (size_t f = begin; f < end; ++f) {
+            Point3 normal = {};
+            uint32_t first = mesh.faceOffset[f];
+            uint32_t last = mesh.faceOffset[f + 1];
+            for (uint32_t i = first; i < last; ++i) {
+                auto& p = mesh.vertex[mesh.vertexArray[i]];
+                auto& q = mesh.vertex[mesh.vertexArray[i + 1 < last ? i + 1 : first]];
+                normal[0] += (p[1] - q[1]) * (p[2] + q[2]);
+                normal[1] += (p[2] - q[2]) * (p[0] + q[0]);
+                normal[2] += (p[0] - q[0]) * (p[1] + q[1]);
+            }
+            faceNormals[f] = normal;
+        }
+    });
+
+    // Corners around each vertex
+    std::pmr::vector<uint32_t> cornerFace(cornerCount, scratch);
+    for (uint32_t f = 0; f < faceCount; ++f) {
+        for (uint32_t i = mesh.faceOffset[f]; i < mesh.faceOffset[f + 1]; ++i) {
+            cornerFace[i] = f;
+        }
+    }
+    std::pmr::vector<uint32_t> vertexOffset(vertexCount + 1, scratch);
+    for (uint32_t index : mesh.vertexArray) {
+        vertexOffset[index + 1]++;
+    }
+    for (size_t i = 0; i < vertexCount; ++i) {
+        vertexOffset[i + 1] += vertexOffset[i];
+    }
+    std::pmr::vector<uint32_t> vertexCorner(cornerCount, scratch);
+    std::pmr::vector<uint32_t> cursor(vertexOffset.begin(), vertexOffset.end() - 1, scratch);
+    for (uint32_t i = 0; i < cornerCount; ++i) {
+        vertexCorner[cursor[mesh.vertexArray[i]]++] = i;
+    }
+    cursor = std::pmr::vector<uint32_t>(scratch);
+
+    // Corners of a vertex share a normal when their faces are linked by shared smoothing
+    // groups. The groups of a vertex are joined with a union-find over the 32 bits.
+    bool smoothing = (mesh.smoothingGroup.size() == faceCount);
+    std::pmr::vector<uint32_t> cornerGroup(cornerCount, scratch);
+    std::pmr::vector<uint32_t> groupCount(vertexCount + 1, scratch);
+    parallelFor(vertexCount, 4096, [&](size_t begin, size_t end) {
+        uint8_t parent[32];
+        uint32_t label[32];
+        auto find = [&](uint32_t bit) {
+            while (parent[bit] != bit) {
+                bit = parent[bit] = parent[parent[bit]];
+            }
+            return bit;
+        };
+        auto lowest = [](uint32_t mask) {
+            uint32_t bit = 0;
+            while ((mask & (1u << bit)) == 0)
+                bit++;
+            return bit;
+        };
+        for (size_t v = begin; v < end; ++v) {
+            for (uint32_t bit = 0; bit < 32; ++bit) {
+                parent[bit] = uint8_t(bit);
+                label[bit] = UINT32_MAX;
+            }
+            for (uint32_t i = vertexOffset[v]; i < vertexOffset[v + 1]; ++i) {
+                uint32_t mask = smoothing ? mesh.smoothingGroup[cornerFace[vertexCorner[i]]] : UINT32_MAX;
+                if (mask == 0)
+                    continue;
+                uint32_t root = find(lowest(mask));
+                for (uint32_t bit = root + 1; bit < 32; ++bit) {
+                    if (mask & (1u << bit)) {
+                        uint32_t other = find(bit);
+                        parent[std::max(root, other)] = uint8_t(std::min(root, other));
+                        root = std::min(root, other);
+                    }
+                }
+            }
+            uint32_t count = 0;
+            for (uint32_t i = vertexOffset[v]; i < vertexOffset[v + 1]; ++i) {
+                uint32_t corner = vertexCorner[i];
+                uint32_t mask = smoothing ? mesh.smoothingGroup[cornerFace[corner]] : UINT32_MAX;
+                if (mask == 0) {
+                    cornerGroup[corner] = count++;
+                    continue;
+                }
+                uint32_t root = find(lowest(mask));
+                if (label[root] == UINT32_MAX)
+                    label[root] = count++;
+                cornerGroup[corner] = label[root];
+            }
+            groupCount[v + 1] = count;
+        }
+    });
+    for (size_t i = 0; i < vertexCount; ++i) {
+        groupCount[i + 1] += groupCount[i];
+    }
+
+    mesh.normal.assign(groupCount.back(), Point3{});
+    mesh.normalIndex.resize(cornerCount);
+    parallelFor(vertexCount, 4096, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            for (uint32_t i = vertexOffset[v]; i < vertexOffset[v + 1]; ++i) {
+                uint32_t corner = vertexCorner[i];
+                uint32_t index = groupCount[v] + cornerGroup[corner];
+                auto& normal = mesh.normal[index];
+                auto& faceNormal = faceNormals[cornerFace[corner]];
+                normal[0] += faceNormal[0];
+                normal[1] += faceNormal[1];
+                normal[2] += faceNormal[2];
+                mesh.normalIndex[corner] = index;
+            }
+            for (uint32_t index = groupCount[v]; index < groupCount[v + 1]; ++index) {
+                auto& normal = mesh.normal[index];
+                float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+                if (length > 0.0f) {
+                    normal[0] /= length;
+                    normal[1] /= length;
+                    normal[2] /= length;
+                }
+            }
+        }
+    });
+}
+
+static void getMaterial(Context& context, Chunk const& chunk, miMaxNode& node)
+{
+    auto& scene = context.scene;
+    auto getName = [&](Chunk const& chunk) {
+        auto* header = getChunk(chunk, 0x4000);
+        auto propertyName = header ? getProperty<uint16_t>(*header, 0x4001) : std::vector<uint16_t>();
+        if (propertyName.empty())
+            return getClassName(context, chunk);
+        return UTF16ToUTF8(propertyName.data(), propertyName.size());
+    };
+
+    // ????????-????????-????????-00000C00 Material         MATERIAL_SUPERCLASS_ID
+    // ????????-00000200-00000000-00000C00 Multi/Sub-Object MULTI_CLASS_ID + MATERIAL_SUPERCLASS_ID
+    if (getClassData(context, chunk).superClassID != MATERIAL_SUPERCLASS_ID) {
+        checkClass(context, chunk, {}, MATERIAL_SUPERCLASS_ID);
+        return;
+    }
+    if (getClassData(context, chunk).classID == MULTI_CLASS_ID) {
+        // Parameter 0 : materialList, 3 : materialIDList
+        // node.material is indexed by material ID, slots without a sub-material stay empty
+        auto* pParamBlock = getLinkChunk(scene, chunk, 0);
+        static ParamBlock const empty;
+        auto& paramBlock = pParamBlock ? getParamBlock(context, *pParamBlock) : empty;
+        std::vector<Chunk const*> materials;
+        if (paramBlock.size() > 0 && paramBlock[0].tab()) {
+            for (size_t i = 0; i < paramBlock[0].count<uint32_t>(); ++i) {
+                auto* material = getParamReference(context, *pParamBlock, paramBlock[0], i);
+                if (material && getClassData(context, *material).superClassID != MATERIAL_SUPERCLASS_ID)
+                    material = nullptr;
+                materials.push_back(material);
+            }
+        }
+        else {
+            for (auto [linkIndex, chunkIndex] : getLink(chunk)) {
+                if (scene.size() <= chunkIndex)
+                    continue;
+                if (getClassData(context, scene[chunkIndex]).superClassID == MATERIAL_SUPERCLASS_ID)
+                    materials.push_back(&scene[chunkIndex]);
+            }
+        }
+        bool idList = (paramBlock.size() > 3 && paramBlock[3].count<int>() == materials.size());
+        for (size_t i = 0; i < materials.size(); ++i) {
+            if (materials[i] == nullptr)
+                continue;
+            int id = idList ? paramBlock[3].get<int>(i) : int(i);
+            if (id < 0 || id > UINT16_MAX) {
+                context.log("%s is corrupted (%d)", "Multi/Sub-Object", id);
+                continue;
+            }
+            if (node.material.size() <= size_t(id))
+                node.material.resize(id + 1);
+            node.material[id] = { getName(*materials[i]), uint32_t(materials[i] - scene.data()) };
+        }
+        return;
+    }
+    node.material.push_back({ getName(chunk), uint32_t(&chunk - scene.data()) });
+}
+
+static uint16_t halfFloat(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(uint32_t));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    int exponent = int((bits >> 23) & 0xFF) - 127 + 15;
+    if (exponent == 0xFF - 127 + 15)
+        return uint16_t(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+    if (exponent >= 31)
+        return uint16_t(sign | 0x7C00);
+    if (exponent <= 0) {
+        if (exponent < -10)
+            return uint16_t(sign);
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t middle = 1u << (shift - 1);
+        if (rest > middle || (rest == middle && (half & 1)))
+            half++;
+        return uint16_t(sign | half);
+    }
+    uint32_t half = (uint32_t(exponent) << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return uint16_t(sign | half);
+}
+
+static float floatHalf(uint16_t half)
+{
+    uint32_t sign = uint32_t(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+    if (exponent == 0) {
+        float value = mantissa / 16777216.0f;
+        return sign ? -value : value;
+    }
+    uint32_t bits = sign | ((exponent == 31 ? 0xFF : exponent - 15 + 127) << 23) | (mantissa << 13);
+    float value;
+    memcpy(&value, &bits, sizeof(float));
+    return value;
+}
+
+static std::array<int16_t, 2> octahedralNormal(Point3 const& normal)
+{
+    float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    if (length == 0.0f)
+        return { 0, 0 };
+    float x = normal[0] / length;
+    float y = normal[1] / length;
+    if (normal[2] < 0.0f) {
+        float fx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float fy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = fx;
+        y = fy;
+    }
+    x = std::clamp(x, -1.0f, 1.0f);
+    y = std::clamp(y, -1.0f, 1.0f);
+    return { int16_t(lrintf(x * 32767.0f)), int16_t(lrintf(y * 32767.0f)) };
+}
+
+Point3 miMaxMesh::Compact::getVertex(size_t index) const
+{
+    if (index >= vertex.size())
+        return {};
+    auto& [x, y, z] = vertex[index];
+    return { offset[0] + x * scale[0], offset[1] + y * scale[1], offset[2] + z * scale[2] };
+}
+
+Point3 miMaxMesh::Compact::getNormal(size_t index) const
+{
+    if (index >= normal.size())
+        return { 0, 0, 1 };
+    float x = normal[index][0] / 32767.0f;
+    float y = normal[index][1] / 32767.0f;
+    float z = 1.0f - fabsf(x) - fabsf(y);
+    float t = std::max(-z, 0.0f);
+    x += x >= 0.0f ? -t : t;
+    y += y >= 0.0f ? -t : t;
+    float length = sqrtf(x * x + y * y + z * z);
+    if (length == 0.0f)
+        return { 0, 0, 1 };
+    return { x / length, y / length, z / length };
+}
+
+static void compactMesh(miMaxMesh& mesh)
+{
+    auto& compact = mesh.compact;
+
+    // Positions are quantized against the bounds of the mesh
+    if (mesh.vertex.empty() == false) {
+        Point3 minimum = mesh.bounds.minimum;
+        Point3 maximum = mesh.bounds.maximum;
+        float inverse[3];
+        for (int i = 0; i < 3; ++i) {
+            float extent = maximum[i] - minimum[i];
+            compact.offset[i] = minimum[i];
+            compact.scale[i] = extent / 65535.0f;
+            inverse[i] = extent > 0.0f ? 65535.0f / extent : 0.0f;
+        }
+        compact.vertex.resize(mesh.vertex.size());
+        parallelFor(mesh.vertex.size(), 65536, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                for (int j = 0; j < 3; ++j) {
+                    float value = (mesh.vertex[i][j] - minimum[j]) * inverse[j] + 0.5f;
+                    compact.vertex[i][j] = uint16_t(std::clamp(value, 0.0f, 65535.0f));
+                }
+            }
+        });
+    }
+    mesh.vertex.clear();
+    mesh.vertex.shrink_to_fit();
+
+    // Normals
+    compact.normal.resize(mesh.normal.size());
+    parallelFor(mesh.normal.size(), 65536, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            compact.normal[i] = octahedralNormal(mesh.normal[i]);
+        }
+    });
+    mesh.normal.clear();
+    mesh.normal.shrink_to_fit();
+
+    // Channels
+    for (auto& [index, source] : mesh.channelSources) {
+        mesh.getChannel(index);
+    }
+    mesh.channelSources.clear();
+    for (auto& [index, channel] : mesh.channels) {
+        auto& output = (*compact.channels.try_emplace(index, compact.vertex.get_allocator().resource()).first).second;
+        size_t count = channel.u.size();
+        auto get = [&](std::pmr::vector<float> const& values, size_t i) {
+            return i < values.size() ? values[i] : 0.0f;
+        };
+        if (index > 0) {
+            output.uv.resize(count);
+            parallelFor(count, 65536, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    output.uv[i] = { halfFloat(get(channel.u, i)), halfFloat(get(channel.v, i)) };
+                }
+            });
+        }
+        else {
+            auto color = [](float value) {
+                return uint8_t(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+            };
+            output.color.resize(count);
+            parallelFor(count, 65536, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    output.color[i] = { color(get(channel.u, i)), color(get(channel.v, i)), color(get(channel.w, i)), 255 };
+                }
+            });
+        }
+        output.index = std::move(channel.index);
+    }
+    mesh.channels.clear();
+
+    // Vertex Alpha
+    auto color = compact.channels.find(0);
+    auto alpha = compact.channels.find(-2);
+    if (color != compact.channels.end() && alpha != compact.channels.end()) {
+        auto& [colorIndex, colorChannel] = *color;
+        auto& [alphaIndex, alphaChannel] = *alpha;
+        if (colorChannel.color.size() == alphaChannel.color.size() && colorChannel.index == alphaChannel.index) {
+            for (size_t i = 0; i < colorChannel.color.size(); ++i) {
+                colorChannel.color[i][3] = alphaChannel.color[i][0];
+            }
+            compact.channels.erase(alpha);
         }
-        checkClass(log, *pParamBlock, {}, 0);
-        break;
-    case class64(SPHERE_CLASS_ID):
-        if (paramBlock.size() > 4) {
-            float radius = std::get<float>(paramBlock[0]);
-            int segments = std::get<int>(paramBlock[1]);
-            bool smooth = std::get<int>(paramBlock[2]);
-            float hemisphere = std::get<float>(paramBlock[3]);
-            int chopSquash = std::get<int>(paramBlock[4]);
-
-            node.text += format("Primitive : %s", "Sphere") + '\n';
-            node.text += format("Radius : %f", radius) + '\n';
-            node.text += format("Segments : %d", segments) + '\n';
-            node.text += format("Smooth : %s", smooth ? "true" : "false") + '\n';
-            node.text += format("Hemisphere : %f", hemisphere) + '\n';
-            node.text += format("ChopSquash : %s", chopSquash == 0 ? "Chop" : "Squash") + '\n';
-            return;
+    }
+}
+
+static std::shared_ptr<miMaxMesh const> getMesh(Context& context, Chunk const& chunk)
+{
+    size_t index = &chunk - context.scene.data();
+    if (index >= context.scene.size())
+        return nullptr;
+    if (context.meshes.size() != context.scene.size())
+        context.meshes.resize(context.scene.size());
+    auto& output = context.meshes[index];
+    if (output == nullptr) {
+        // Timers run on the worker decoding the mesh, so the trace breaks the geometry pass down by thread
+        auto mesh = std::allocate_shared<miMaxMesh>(std::pmr::polymorphic_allocator<miMaxMesh>(context.resource), context.resource);
+        PROFILE_TIMER(timerPrimitive, "Mesh Primitive");
+        getPrimitive(context, chunk, *mesh);
+        PROFILE_STOP(timerPrimitive);
+        PROFILE_TIMER(timerMaterial, "Mesh Material");
+        sortMaterial(*mesh);
+        PROFILE_STOP(timerMaterial);
+        PROFILE_TIMER(timerNormal, "Mesh Normal");
+        generateNormal(*mesh);
+        PROFILE_STOP(timerNormal);
+        PROFILE_TIMER(timerBounds, "Mesh Bounds");
+        getBounds(*mesh);
+        PROFILE_STOP(timerBounds);
+        if (context.compact) {
+            PROFILE_TIMER(timerCompact, "Mesh Compact");
+            compactMesh(*mesh);
         }
-        checkClass(log, *pParamBlock, {}, 0);
-        break;
-    case class64(CYLINDER_CLASS_ID):
-        if (paramBlock.size() > 5) {
-            float radius = std::get<float>(paramBlock[0]);
-            float height = std::get<float>(paramBlock[1]);
-            int heightSegments = std::get<int>(paramBlock[2]);
-            int capSegments = std::get<int>(paramBlock[3]);
-            int sides = std::get<int>(paramBlock[4]);
-            bool smooth = std::get<int>(paramBlock[5]);
-
-            node.text += format("Primitive : %s", "Cylinder") + '\n';
-            node.text += format("Radius : %f", radius) + '\n';
-            node.text += format("Height : %f", height) + '\n';
-            node.text += format("Height Segments : %d", heightSegments) + '\n';
-            node.text += format("Cap Segments : %d", capSegments) + '\n';
-            node.text += format("Sides : %d", sides) + '\n';
-            node.text += format("Smooth : %s", smooth ? "true" : "false") + '\n';
-            return;
+        output = std::move(mesh);
+    }
+    return output;
+}
+
+static void diffChunk(miMaxNode const& leftRoot, miMaxNode const& rightRoot, Chunk const& left, Chunk const& right, std::string const& path, std::vector<miMaxDiff>& diff)
+{
+    auto getName = [](miMaxNode const& root, Chunk const& chunk) {
+        if (root.classes.size() <= chunk.classIndex)
+            return format("%04X", chunk.type);
+        return root.classes[chunk.classIndex].name;
+    };
+    auto added = [&](size_t index) {
+        auto& chunk = right[index];
+        diff.push_back({ miMaxDiff::ADDED, chunk.type, path + format("/%zX", index), getName(rightRoot, chunk), nullptr, &chunk });
+    };
+    auto removed = [&](size_t index) {
+        auto& chunk = left[index];
+        diff.push_back({ miMaxDiff::REMOVED, chunk.type, path + format("/%zX", index), getName(leftRoot, chunk), &chunk, nullptr });
+    };
+    auto modified = [&](size_t leftIndex, size_t rightIndex) {
+        auto& leftChunk = left[leftIndex];
+        auto& rightChunk = right[rightIndex];
+        std::string childPath = path + format("/%zX", leftIndex);
+        size_t count = diff.size();
+        if (leftChunk.empty() == false && rightChunk.empty() == false) {
+            diffChunk(leftRoot, rightRoot, leftChunk, rightChunk, childPath, diff);
         }
-        checkClass(log, *pParamBlock, {}, 0);
-        break;
-    case class64(TORUS_CLASS_ID):
-        if (paramBlock.size() > 6) {
-            float radius1 = std::get<float>(paramBlock[0]);
-            float radius2 = std::get<float>(paramBlock[1]);
-            float rotation = std::get<float>(paramBlock[2]);
-            float twist = std::get<float>(paramBlock[3]);
-            int segments = std::get<int>(paramBlock[4]);
-            int sides = std::get<int>(paramBlock[5]);
-            int smooth = std::get<int>(paramBlock[6]);
-
-            node.text += format("Primitive : %s", "Torus") + '\n';
-            node.text += format("Radius1 : %f", radius1) + '\n';
-            node.text += format("Radius2 : %f", radius2) + '\n';
-            node.text += format("Rotation : %f", rotation) + '\n';
-            node.text += format("Twist : %f", twist) + '\n';
-            node.text += format("Segments : %d", segments) + '\n';
-            node.text += format("Sides : %d", sides) + '\n';
-            node.text += format("Smooth : %d", smooth) + '\n';
-            return;
+        if (count == diff.size()) {
+            diff.push_back({ miMaxDiff::MODIFIED, leftChunk.type, childPath, getName(leftRoot, leftChunk), &leftChunk, &rightChunk });
         }
-        checkClass(log, *pParamBlock, {}, 0);
-        break;
-    case class64(CONE_CLASS_ID):
-        if (paramBlock.size() > 6) {
-            float radius1 = std::get<float>(paramBlock[0]);
-            float radius2 = std::get<float>(paramBlock[1]);
-            float height = std::get<float>(paramBlock[2]);
-            int heightSegments = std::get<int>(paramBlock[3]);
-            int capSegments = std::get<int>(paramBlock[4]);
-            int sides = std::get<int>(paramBlock[5]);
-            bool smooth = std::get<int>(paramBlock[6]);
-
-            node.text += format("Primitive : %s", "Cone") + '\n';
-            node.text += format("Radius1 : %f", radius1) + '\n';
-            node.text += format("Radius2 : %f", radius2) + '\n';
-            node.text += format("Height : %f", height) + '\n';
-            node.text += format("Height Segments : %d", heightSegments) + '\n';
-            node.text += format("Cap Segments : %d", capSegments) + '\n';
-            node.text += format("Sides : %d", sides) + '\n';
-            node.text += format("Smooth : %s", smooth ? "true" : "false") + '\n';
-            return;
+    };
+
+    // Unchanged subtrees at both ends are skipped by hash
+    size_t leftCount = left.size();
+    size_t rightCount = right.size();
+    size_t prefix = 0;
+    while (prefix < leftCount && prefix < rightCount && left[prefix].hash == right[prefix].hash)
+        prefix++;
+    size_t suffix = 0;
+    while (suffix < leftCount - prefix && suffix < rightCount - prefix && left[leftCount - 1 - suffix].hash == right[rightCount - 1 - suffix].hash)
+        suffix++;
+
+    // Moved subtrees are matched by hash
+    std::map<uint64_t, std::vector<size_t>> rightHashes;
+    for (size_t i = rightCount - suffix; i > prefix; --i) {
+        rightHashes[right[i - 1].hash].push_back(i - 1);
+    }
+    std::vector<size_t> leftRemain;
+    std::vector<bool> rightMatched(rightCount);
+    for (size_t i = prefix; i < leftCount - suffix; ++i) {
+        auto it = rightHashes.find(left[i].hash);
+        if (it == rightHashes.end() || (*it).second.empty()) {
+            leftRemain.push_back(i);
+            continue;
         }
-        checkClass(log, *pParamBlock, {}, 0);
-        break;
-    case class64(GSPHERE_CLASS_ID):
-        if (paramBlock.size() > 4) {
-            float radius = std::get<float>(paramBlock[0]);
-            int segments = std::get<int>(paramBlock[1]);
-            int geodesicBaseType = std::get<int>(paramBlock[2]);
-            bool smooth = std::get<int>(paramBlock[3]);
-            bool hemisphere = std::get<int>(paramBlock[4]);
-
-            node.text += format("Primitive : %s", "GeoSphere") + '\n';
-            node.text += format("Radius : %f", radius) + '\n';
-            node.text += format("Segments : %d", segments) + '\n';
-            node.text += format("Geodesic Base Type : %d", geodesicBaseType) + '\n';
-            node.text += format("Smooth : %f", smooth ? "true" : "false") + '\n';
-            node.text += format("Hemisphere : %f", hemisphere ? "true" : "false") + '\n';
+        rightMatched[(*it).second.back()] = true;
+        (*it).second.pop_back();
+    }
+    std::vector<size_t> rightRemain;
+    for (size_t i = prefix; i < rightCount - suffix; ++i) {
+        if (rightMatched[i] == false)
+            rightRemain.push_back(i);
+    }
+
+    // The rest is paired in order by chunk type
+    size_t i = 0;
+    size_t j = 0;
+    while (i < leftRemain.size() || j < rightRemain.size()) {
+        if (i == leftRemain.size()) {
+            added(rightRemain[j++]);
+            continue;
+        }
+        if (j == rightRemain.size()) {
+            removed(leftRemain[i++]);
+            continue;
+        }
+        uint16_t type = left[leftRemain[i]].type;
+        if (type == right[rightRemain[j]].type) {
+            modified(leftRemain[i++], rightRemain[j++]);
+            continue;
+        }
+        size_t k = j + 1;
+        while (k < rightRemain.size() && k < j + 8 && right[rightRemain[k]].type != type)
+            k++;
+        if (k < rightRemain.size() && right[rightRemain[k]].type == type) {
+            while (j < k)
+                added(rightRemain[j++]);
+            continue;
+        }
+        removed(leftRemain[i++]);
+    }
+}
+
+void miMAXDiffFile(miMaxNode const& left, miMaxNode const& right, std::vector<miMaxDiff>& diff)
+{
+    static Chunk const empty;
+    std::tuple<char const*, Chunk const*, Chunk const*> streams[] = {
+        { "ClassData",      left.classData,         right.classData         },
+        { "ClassDirectory", left.classDirectory,    right.classDirectory    },
+        { "Config",         left.config,            right.config            },
+        { "DllDirectory",   left.dllDirectory,      right.dllDirectory      },
+        { "Scene",          left.scene,             right.scene             },
+        { "VideoPostQueue", left.videoPostQueue,    right.videoPostQueue    },
+    };
+    for (auto [name, leftStream, rightStream] : streams) {
+        auto& leftChunk = leftStream ? *leftStream : empty;
+        auto& rightChunk = rightStream ? *rightStream : empty;
+        if (leftChunk.hash == rightChunk.hash)
+            continue;
+        diffChunk(left, right, leftChunk, rightChunk, name, diff);
+    }
+}
+
+static std::string escapeJSON(std::string const& text)
+{
+    std::string output;
+    for (char c : text) {
+        switch (c) {
+        case '"':   output += "\\\"";    break;
+        case '\\':  output += "\\\\";   break;
+        default:
+            if ((uint8_t)c < 0x20) {
+                output += format("\\u%04X", (uint8_t)c);
+                break;
+            }
+            output += c;
+            break;
+        }
+    }
+    return output;
+}
+
+bool miMAXExportGLB(miMaxNode const& root, char const* name, int(*log)(char const*, ...))
+{
+    struct Mesh
+    {
+        miMaxMesh const* mesh = nullptr;
+        miMaxMesh::Channel const* texcoord = nullptr;
+        miMaxMesh::Compact::Channel const* compactTexcoord = nullptr;
+        bool normal = false;
+        size_t corner = 0;
+        size_t positionOffset = 0;
+        size_t normalOffset = 0;
+        size_t texcoordOffset = 0;
+        std::vector<std::tuple<miMaxMesh::MaterialRange, size_t, size_t>> primitives;
+        std::vector<uint32_t> faceOffset;
+        miMaxBounds bounds;
+
+        // Written corners of a face, empty when the face is dropped
+        uint32_t const* offsets() const
+        {
+            return faceOffset.empty() ? mesh->faceOffset.data() : faceOffset.data();
+        }
+    };
+    auto forEachCorner = [](Mesh const& output, size_t face, auto&& function) {
+        uint32_t const* written = output.offsets();
+        uint32_t first = output.mesh->faceOffset[face];
+        uint32_t last = output.mesh->faceOffset[face + 1];
+        if (written[face + 1] - written[face] != last - first)
             return;
+        for (uint32_t corner = first, target = written[face]; corner < last; ++corner, ++target) {
+            function(corner, target);
         }
-        checkClass(log, *pParamBlock, {}, 0);
-        break;
-    case class64(TUBE_CLASS_ID):
-        if (paramBlock.size() > 6) {
-            float radius1 = std::get<float>(paramBlock[0]);
-            float radius2 = std::get<float>(paramBlock[1]);
-            float height = std::get<float>(paramBlock[2]);
-            int heightSegments = std::get<int>(paramBlock[3]);
-            int capSegments = std::get<int>(paramBlock[4]);
-            int sides = std::get<int>(paramBlock[5]);
-            bool smooth = std::get<int>(paramBlock[6]);
-
-            node.text += format("Primitive : %s", "Tube") + '\n';
-            node.text += format("Radius1 : %f", radius1) + '\n';
-            node.text += format("Radius2 : %f", radius2) + '\n';
-            node.text += format("Height : %f", height) + '\n';
-            node.text += format("Height Segments : %d", heightSegments) + '\n';
-            node.text += format("Cap Segments : %d", capSegments) + '\n';
-            node.text += format("Sides : %d", sides) + '\n';
-            node.text += format("Smooth : %s", smooth ? "true" : "false") + '\n';
+    };
+
+    // Nodes in pre-order, with meshes shared between instances
+    std::vector<miMaxNode const*> nodes;
+    std::vector<std::vector<uint32_t>> children(1);
+    std::vector<Mesh> meshes;
+    std::map<miMaxMesh const*, uint32_t> meshIndices;
+    std::function<void(miMaxNode const&, uint32_t)> flatten = [&](miMaxNode const& node, uint32_t parent) {
+        for (auto& child : node) {
+            uint32_t index = uint32_t(nodes.size() + 1);
+            nodes.push_back(&child);
+            children.emplace_back();
+            children[parent].push_back(index);
+            auto* mesh = child.mesh.get();
+            auto triangle = [](miMaxMesh const& mesh) {
+                for (size_t i = 0; i + 1 < mesh.faceOffset.size(); ++i) {
+                    if (mesh.faceOffset[i + 1] - mesh.faceOffset[i] > 2)
+                        return true;
+                }
+                return false;
+            };
+            if (mesh && getVertexCount(*mesh) != 0 && meshIndices.count(mesh) == 0 && triangle(*mesh)) {
+                meshIndices[mesh] = uint32_t(meshes.size());
+                meshes.emplace_back().mesh = mesh;
+            }
+            flatten(child, index);
+        }
+    };
+    flatten(root, 0);
+
+    // Faces with a vertex out of range are dropped, and the corners of the rest packed in face order
+    for (auto& output : meshes) {
+        auto& mesh = *output.mesh;
+        size_t faceCount = mesh.faceOffset.size() - 1;
+        size_t vertexCount = getVertexCount(mesh);
+        std::vector<uint32_t> faceOffset(faceCount + 1);
+        size_t dropped = 0;
+        for (size_t f = 0; f < faceCount; ++f) {
+            uint32_t first = mesh.faceOffset[f];
+            uint32_t last = mesh.faceOffset[f + 1];
+            bool valid = std::all_of(mesh.vertexArray.begin() + first, mesh.vertexArray.begin() + last, [&](uint32_t index) {
+                return index < vertexCount;
+            });
+            dropped += valid ? 0 : 1;
+            faceOffset[f + 1] = faceOffset[f] + (valid ? last - first : 0);
+        }
+        if (dropped) {
+            log("Faces are dropped (%s : %zu)", name, dropped);
+            output.faceOffset = std::move(faceOffset);
+        }
+    }
+
+    // Meshes without a single triangle are dropped, and the rest renumbered
+    for (auto& output : meshes) {
+        auto& mesh = *output.mesh;
+        uint32_t const* offsets = output.offsets();
+        size_t faceCount = mesh.faceOffset.size() - 1;
+        auto ranges = mesh.materialRange;
+        if (ranges.empty())
+            ranges.push_back({ 0, 0, uint32_t(faceCount) });
+        for (auto const& range : ranges) {
+            size_t count = 0;
+            for (size_t f = range.faceBegin; f < range.faceBegin + range.faceCount && f < faceCount; ++f) {
+                size_t corner = offsets[f + 1] - offsets[f];
+                count += corner > 2 ? (corner - 2) * 3 : 0;
+            }
+            if (count == 0)
+                continue;
+            output.primitives.emplace_back(range, 0, count);
+        }
+    }
+    meshes.erase(std::remove_if(meshes.begin(), meshes.end(), [](Mesh const& output) {
+        return output.primitives.empty();
+    }), meshes.end());
+    meshIndices.clear();
+    for (size_t m = 0; m < meshes.size(); ++m) {
+        meshIndices[meshes[m].mesh] = uint32_t(m);
+    }
+
+    // Buffer layout, each mesh is one contiguous block
+    size_t binary = 0;
+    auto allocate = [&](size_t size) {
+        size_t offset = binary;
+        binary += (size + 3) & ~size_t(3);
+        return offset;
+    };
+    for (auto& output : meshes) {
+        auto& mesh = *output.mesh;
+        size_t faceCount = mesh.faceOffset.size() - 1;
+        output.corner = output.offsets()[faceCount];
+        size_t normalCount = mesh.vertex.empty() ? mesh.compact.normal.size() : mesh.normal.size();
+        output.normal = normalCount != 0 && mesh.normalIndex.size() == mesh.vertexArray.size();
+
+        // Compact meshes carry their texture coordinates as half floats
+        if (mesh.vertex.empty()) {
+            auto it = mesh.compact.channels.find(1);
+            output.compactTexcoord = it != mesh.compact.channels.end() ? &(*it).second : nullptr;
+            if (output.compactTexcoord) {
+                auto& channel = *output.compactTexcoord;
+                auto& index = channel.index.empty() ? mesh.vertexArray : channel.index;
+                if (index.size() != mesh.vertexArray.size() || channel.uv.empty())
+                    output.compactTexcoord = nullptr;
+            }
+        }
+        else {
+            output.texcoord = mesh.getChannel(1);
+            if (output.texcoord) {
+                auto& channel = *output.texcoord;
+                auto& index = channel.index.empty() ? mesh.vertexArray : channel.index;
+                if (index.size() != mesh.vertexArray.size() || channel.u.size() != channel.v.size())
+                    output.texcoord = nullptr;
+            }
+        }
+        bool texcoord = output.texcoord || output.compactTexcoord;
+        output.positionOffset = allocate(output.corner * sizeof(Point3));
+        output.normalOffset = output.normal ? allocate(output.corner * sizeof(Point3)) : 0;
+        output.texcoordOffset = texcoord ? allocate(output.corner * sizeof(float) * 2) : 0;
+        for (auto& [range, offset, count] : output.primitives) {
+            offset = allocate(count * sizeof(uint32_t));
+        }
+
+        // POSITION bounds cover exactly the corners written below
+        size_t block = 16384;
+        std::vector<miMaxBounds> blocks((faceCount + block - 1) / block);
+        parallelFor(blocks.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t b = begin; b < end; ++b) {
+                for (size_t f = b * block, last = std::min(faceCount, f + block); f < last; ++f) {
+                    forEachCorner(output, f, [&](uint32_t corner, uint32_t) {
+                        blocks[b].merge(getVertex(mesh, mesh.vertexArray[corner]));
+                    });
+                }
+            }
+        });
+        for (auto& bounds : blocks) {
+            output.bounds.merge(bounds);
+        }
+    }
+
+    // JSON is written straight into a string, without a document tree
+    std::string json;
+    json += "{\"asset\":{\"version\":\"2.0\",\"generator\":\"miMAX\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}]";
+
+    // 3ds Max is Z-up while glTF is Y-up
+    json += ",\"nodes\":[{\"name\":\"" + escapeJSON(root.name) + "\",\"rotation\":[-0.70710678,0,0,0.70710678]";
+    for (size_t i = 0; i <= nodes.size(); ++i) {
+        if (i) {
+            auto& node = *nodes[i - 1];
+            json += ",{\"name\":\"" + escapeJSON(node.name) + "\"";
+            json += format(",\"translation\":[%.9g,%.9g,%.9g]", node.position[0], node.position[1], node.position[2]);
+            json += format(",\"rotation\":[%.9g,%.9g,%.9g,%.9g]", node.rotation[0], node.rotation[1], node.rotation[2], node.rotation[3]);
+            json += format(",\"scale\":[%.9g,%.9g,%.9g]", node.scale[0], node.scale[1], node.scale[2]);
+            auto it = meshIndices.find(node.mesh.get());
+            if (it != meshIndices.end() && meshes[(*it).second].primitives.empty() == false)
+                json += format(",\"mesh\":%u", (*it).second);
+        }
+        if (children[i].empty() == false) {
+            json += ",\"children\":[";
+            for (size_t j = 0; j < children[i].size(); ++j)
+                json += format(j ? ",%u" : "%u", children[i][j]);
+            json += "]";
+        }
+        json += "}";
+    }
+    json += "]";
+
+    std::string jsonMeshes;
+    std::string jsonAccessors;
+    std::string jsonViews;
+    size_t accessor = 0;
+    auto addAccessor = [&](size_t offset, size_t size, size_t count, char const* type, uint32_t componentType, uint32_t target, std::string const& extra) {
+        jsonViews += format("%s{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu,\"target\":%u}", accessor ? "," : "", offset, size, target);
+        jsonAccessors += format("%s{\"bufferView\":%zu,\"componentType\":%u,\"count\":%zu,\"type\":\"%s\"%s}", accessor ? "," : "", accessor, componentType, count, type, extra.c_str());
+        return accessor++;
+    };
+    for (size_t m = 0; m < meshes.size(); ++m) {
+        auto& output = meshes[m];
+        auto& bounds = output.bounds;
+        std::string extra = format(",\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]", bounds.minimum[0], bounds.minimum[1], bounds.minimum[2], bounds.maximum[0], bounds.maximum[1], bounds.maximum[2]);
+        std::string attributes = format("\"POSITION\":%zu", addAccessor(output.positionOffset, output.corner * sizeof(Point3), output.corner, "VEC3", 5126, 34962, extra));
+        if (output.normal)
+            attributes += format(",\"NORMAL\":%zu", addAccessor(output.normalOffset, output.corner * sizeof(Point3), output.corner, "VEC3", 5126, 34962, ""));
+        if (output.texcoord || output.compactTexcoord)
+            attributes += format(",\"TEXCOORD_0\":%zu", addAccessor(output.texcoordOffset, output.corner * sizeof(float) * 2, output.corner, "VEC2", 5126, 34962, ""));
+        jsonMeshes += format("%s{\"primitives\":[", m ? "," : "");
+        for (size_t p = 0; p < output.primitives.size(); ++p) {
+            auto& [range, offset, count] = output.primitives[p];
+            size_t indices = addAccessor(offset, count * sizeof(uint32_t), count, "SCALAR", 5125, 34963, "");
+            jsonMeshes += format("%s{\"attributes\":{%s},\"indices\":%zu}", p ? "," : "", attributes.c_str(), indices);
+        }
+        jsonMeshes += "]}";
+    }
+    if (meshes.empty() == false) {
+        json += ",\"meshes\":[" + jsonMeshes + "]";
+        json += ",\"accessors\":[" + jsonAccessors + "]";
+        json += ",\"bufferViews\":[" + jsonViews + "]";
+        json += format(",\"buffers\":[{\"byteLength\":%zu}]", binary);
+    }
+    json += "}";
+    while (json.size() % 4)
+        json += ' ';
+
+    // GLB sizes are 32-bit
+    size_t total = 12 + 8 + json.size() + (binary ? 8 + binary : 0);
+    if (total > UINT32_MAX) {
+        log("File is too large (%s : %zu)", name, total);
+        return false;
+    }
+
+    // Header, JSON chunk and BIN chunk
+    FILE* file = fopen(name, "wb");
+    if (file == nullptr) {
+        log("File is not created (%s)", name);
+        return false;
+    }
+    uint32_t header[3] = { 0x46546C67, 2, uint32_t(total) };
+    uint32_t jsonHeader[2] = { uint32_t(json.size()), 0x4E4F534A };
+    uint32_t binaryHeader[2] = { uint32_t(binary), 0x004E4942 };
+    bool result = true;
+    result &= fwrite(header, sizeof(header), 1, file) == 1;
+    result &= fwrite(jsonHeader, sizeof(jsonHeader), 1, file) == 1;
+    result &= fwrite(json.data(), json.size(), 1, file) == 1;
+    if (binary) {
+        result &= fwrite(binaryHeader, sizeof(binaryHeader), 1, file) == 1;
+    }
+
+    // The BIN chunk is streamed one mesh at a time, so only the largest mesh is held in memory
+    std::vector<char> buffer;
+    for (size_t m = 0; m < meshes.size() && result; ++m) {
+        auto& output = meshes[m];
+        auto& mesh = *output.mesh;
+        size_t begin = output.positionOffset;
+        size_t end = (m + 1 < meshes.size()) ? meshes[m + 1].positionOffset : binary;
+        buffer.assign(end - begin, 0);
+        size_t faceCount = mesh.faceOffset.size() - 1;
+        auto writeCorners = [&](auto&& function) {
+            parallelFor(faceCount, 16384, [&](size_t first, size_t last) {
+                for (size_t f = first; f < last; ++f) {
+                    forEachCorner(output, f, function);
+                }
+            });
+        };
+        auto* position = (Point3*)(buffer.data() + output.positionOffset - begin);
+        writeCorners([&](uint32_t corner, uint32_t target) {
+            position[target] = getVertex(mesh, mesh.vertexArray[corner]);
+        });
+        if (output.normal) {
+            auto* normal = (Point3*)(buffer.data() + output.normalOffset - begin);
+            writeCorners([&](uint32_t corner, uint32_t target) {
+                uint32_t index = mesh.normalIndex[corner];
+                if (mesh.vertex.empty())
+                    normal[target] = mesh.compact.getNormal(index);
+                else
+                    normal[target] = index < mesh.normal.size() ? mesh.normal[index] : Point3{ 0, 0, 1 };
+            });
+        }
+        if (output.texcoord) {
+            auto& channel = *output.texcoord;
+            auto& indices = channel.index.empty() ? mesh.vertexArray : channel.index;
+            auto* texcoord = (float*)(buffer.data() + output.texcoordOffset - begin);
+            writeCorners([&](uint32_t corner, uint32_t target) {
+                uint32_t index = indices[corner];
+                bool valid = index < channel.u.size();
+                texcoord[target * 2 + 0] = valid ? channel.u[index] : 0.0f;
+                texcoord[target * 2 + 1] = valid ? 1.0f - channel.v[index] : 0.0f;
+            });
+        }
+        if (output.compactTexcoord) {
+            auto& channel = *output.compactTexcoord;
+            auto& indices = channel.index.empty() ? mesh.vertexArray : channel.index;
+            auto* texcoord = (float*)(buffer.data() + output.texcoordOffset - begin);
+            writeCorners([&](uint32_t corner, uint32_t target) {
+                uint32_t index = indices[corner];
+                bool valid = index < channel.uv.size();
+                texcoord[target * 2 + 0] = valid ? floatHalf(channel.uv[index][0]) : 0.0f;
+                texcoord[target * 2 + 1] = valid ? 1.0f - floatHalf(channel.uv[index][1]) : 0.0f;
+            });
+        }
+        uint32_t const* offsets = output.offsets();
+        for (auto& [range, offset, count] : output.primitives) {
+            auto* index = (uint32_t*)(buffer.data() + offset - begin);
+            std::pmr::vector<uint32_t> triangles;
+            for (size_t f = range.faceBegin; f < range.faceBegin + range.faceCount && f < faceCount; ++f) {
+                if (offsets[f + 1] - offsets[f] < 3)
+                    continue;
+                triangles.clear();
+                triangulateFace(mesh, f, triangles);
+                for (uint32_t corner : triangles) {
+                    *index++ = corner - mesh.faceOffset[f] + offsets[f];
+                }
+            }
+        }
+        result &= fwrite(buffer.data(), buffer.size(), 1, file) == 1;
+    }
+    fclose(file);
+    if (result == false) {
+        log("File is not written (%s)", name);
+    }
+    return result;
+}
+
+static float surfaceArea(miMaxBounds const& bounds)
+{
+    if (bounds.empty())
+        return 0.0f;
+    float x = bounds.maximum[0] - bounds.minimum[0];
+    float y = bounds.maximum[1] - bounds.minimum[1];
+    float z = bounds.maximum[2] - bounds.minimum[2];
+    return 2.0f * (x * y + y * z + z * x);
+}
+
+static void buildBVH(miMaxBVH& bvh, std::vector<Point3> const& centers, std::vector<uint32_t>& order, std::atomic<uint32_t>& allocated, uint32_t nodeIndex, uint32_t begin, uint32_t end, int depth)
+{
+    static constexpr int binCount = 16;
+
+    auto& node = bvh.nodes[nodeIndex];
+    miMaxBounds centerBounds;
+    for (uint32_t i = begin; i < end; ++i) {
+        node.bounds.merge(bvh.items[order[i]].node->bounds);
+        centerBounds.merge(centers[order[i]]);
+    }
+    uint32_t count = end - begin;
+    auto leaf = [&]() {
+        node.index = begin;
+        node.count = count;
+    };
+    if (count <= 2) {
+        leaf();
+        return;
+    }
+
+    // Binned SAH along the widest axis of the centers
+    int axis = 0;
+    for (int i = 1; i < 3; ++i) {
+        if (centerBounds.maximum[i] - centerBounds.minimum[i] > centerBounds.maximum[axis] - centerBounds.minimum[axis])
+            axis = i;
+    }
+    float minimum = centerBounds.minimum[axis];
+    float extent = centerBounds.maximum[axis] - minimum;
+    auto binOf = [&](uint32_t item) {
+        int bin = extent > 0.0f ? int((centers[item][axis] - minimum) / extent * binCount) : 0;
+        return std::clamp(bin, 0, binCount - 1);
+    };
+    uint32_t split = begin + count / 2;
+    if (extent > 0.0f) {
+        miMaxBounds bins[binCount];
+        uint32_t binCounts[binCount] = {};
+        for (uint32_t i = begin; i < end; ++i) {
+            int bin = binOf(order[i]);
+            bins[bin].merge(bvh.items[order[i]].node->bounds);
+            binCounts[bin]++;
+        }
+        float rightCosts[binCount] = {};
+        miMaxBounds right;
+        uint32_t rightCount = 0;
+        for (int i = binCount - 1; i > 0; --i) {
+            right.merge(bins[i]);
+            rightCount += binCounts[i];
+            rightCosts[i] = surfaceArea(right) * rightCount;
+        }
+        int bestBin = 0;
+        float bestCost = FLT_MAX;
+        miMaxBounds left;
+        uint32_t leftCount = 0;
+        for (int i = 0; i + 1 < binCount; ++i) {
+            left.merge(bins[i]);
+            leftCount += binCounts[i];
+            float cost = surfaceArea(left) * leftCount + rightCosts[i + 1];
+            if (leftCount && leftCount < count && cost < bestCost) {
+                bestCost = cost;
+                bestBin = i;
+            }
+        }
+        if (count <= 4 && bestCost >= surfaceArea(node.bounds) * count) {
+            leaf();
             return;
         }
-        checkClass(log, *pParamBlock, {}, 0);
-        break;
-    case class64(PYRAMID_CLASS_ID):
-        if (paramBlock.size() > 5) {
-            float width = std::get<float>(paramBlock[0]);
-            float depth = std::get<float>(paramBlock[1]);
-            float height = std::get<float>(paramBlock[2]);
-            int widthSegments = std::get<int>(paramBlock[3]);
-            int depthSegments = std::get<int>(paramBlock[4]);
-            int heightSegments = std::get<int>(paramBlock[5]);
-
-            node.text += format("Primitive : %s", "Pyramid") + '\n';
-            node.text += format("Width : %f", width) + '\n';
-            node.text += format("Depth : %f", depth) + '\n';
-            node.text += format("Height : %f", height) + '\n';
-            node.text += format("Width Segments : %d", widthSegments) + '\n';
-            node.text += format("Depth Segments : %d", depthSegments) + '\n';
-            node.text += format("Height Segments : %d", heightSegments) + '\n';
-            return;
+        if (bestCost < FLT_MAX) {
+            auto middle = std::partition(order.begin() + begin, order.begin() + end, [&](uint32_t item) {
+                return binOf(item) <= bestBin;
+            });
+            split = uint32_t(middle - order.begin());
+        }
+    }
+
+    // Children are allocated in pairs, and large subtrees are built as pool tasks
+    uint32_t child = allocated.fetch_add(2);
+    node.index = child;
+    node.count = 0;
+    if (count >= 4096 && depth < 4 && parallelSerial == false) {
+        auto& pool = ThreadPool::instance();
+        std::atomic<size_t> pending = { 0 };
+        pool.submit(pending, [&]() {
+            buildBVH(bvh, centers, order, allocated, child, begin, split, depth + 1);
+        });
+        buildBVH(bvh, centers, order, allocated, child + 1, split, end, depth + 1);
+        pool.wait(pending);
+        return;
+    }
+    buildBVH(bvh, centers, order, allocated, child, begin, split, depth + 1);
+    buildBVH(bvh, centers, order, allocated, child + 1, split, end, depth + 1);
+}
+
+void miMAXBuildBVH(miMaxNode const& root, miMaxBVH& bvh)
+{
+    bvh.nodes.clear();
+    bvh.items.clear();
+
+    std::function<void(miMaxNode const&, Matrix const&)> collect = [&](miMaxNode const& node, Matrix const& world) {
+        for (auto& child : node) {
+            Matrix childWorld = multiplyMatrix(world, localMatrix(child));
+            if (child.bounds.empty() == false)
+                bvh.items.push_back({ &child, childWorld });
+            collect(child, childWorld);
+        }
+    };
+    collect(root, { 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0 });
+    if (bvh.items.empty())
+        return;
+
+    std::vector<Point3> centers(bvh.items.size());
+    std::vector<uint32_t> order(bvh.items.size());
+    for (uint32_t i = 0; i < bvh.items.size(); ++i) {
+        auto& bounds = bvh.items[i].node->bounds;
+        for (int j = 0; j < 3; ++j) {
+            centers[i][j] = (bounds.minimum[j] + bounds.maximum[j]) * 0.5f;
+        }
+        order[i] = i;
+    }
+
+    std::atomic<uint32_t> allocated = { 1 };
+    bvh.nodes.resize(bvh.items.size() * 2 - 1);
+    buildBVH(bvh, centers, order, allocated, 0, 0, uint32_t(order.size()), 0);
+    bvh.nodes.resize(allocated);
+
+    std::vector<miMaxBVH::Item> items(order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        items[i] = bvh.items[order[i]];
+    }
+    bvh.items = std::move(items);
+}
+
+static bool intersectBounds(miMaxBounds const& bounds, Point3 const& origin, Point3 const& inverse, float limit, float& distance)
+{
+    float enter = 0.0f;
+    float leave = limit;
+    for (int i = 0; i < 3; ++i) {
+        float t0 = (bounds.minimum[i] - origin[i]) * inverse[i];
+        float t1 = (bounds.maximum[i] - origin[i]) * inverse[i];
+        if (t0 > t1)
+            std::swap(t0, t1);
+        enter = std::max(enter, t0);
+        leave = std::min(leave, t1);
+        if (enter > leave)
+            return false;
+    }
+    distance = enter;
+    return true;
+}
+
+static bool intersectTriangle(Point3 const& origin, Point3 const& direction, Point3 const& a, Point3 const& b, Point3 const& c, float& distance)
+{
+    Point3 ab = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    Point3 ac = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    Point3 p = { direction[1] * ac[2] - direction[2] * ac[1], direction[2] * ac[0] - direction[0] * ac[2], direction[0] * ac[1] - direction[1] * ac[0] };
+    float determinant = ab[0] * p[0] + ab[1] * p[1] + ab[2] * p[2];
+    if (fabsf(determinant) < 1e-12f)
+        return false;
+    float inverse = 1.0f / determinant;
+    Point3 t = { origin[0] - a[0], origin[1] - a[1], origin[2] - a[2] };
+    float u = (t[0] * p[0] + t[1] * p[1] + t[2] * p[2]) * inverse;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+    Point3 q = { t[1] * ab[2] - t[2] * ab[1], t[2] * ab[0] - t[0] * ab[2], t[0] * ab[1] - t[1] * ab[0] };
+    float v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inverse;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+    distance = (ac[0] * q[0] + ac[1] * q[1] + ac[2] * q[2]) * inverse;
+    return distance >= 0.0f;
+}
+
+bool miMaxBVH::raycast(Point3 const& origin, Point3 const& direction, Hit& hit) const
+{
+    if (nodes.empty())
+        return false;
+
+    Point3 inverse;
+    for (int i = 0; i < 3; ++i) {
+        inverse[i] = direction[i] != 0.0f ? 1.0f / direction[i] : FLT_MAX;
+    }
+
+    // Meshes are tested triangle by triangle in world space, bounds stand in for meshes without faces
+    auto intersectItem = [&](Item const& item) {
+        auto& mesh = *item.node->mesh;
+        auto vertex = [&](uint32_t index) {
+            return transformMatrix(item.world, getVertex(mesh, index));
+        };
+        bool found = false;
+        for (size_t f = 0; f + 1 < mesh.faceOffset.size(); ++f) {
+            uint32_t first = mesh.faceOffset[f];
+            uint32_t last = mesh.faceOffset[f + 1];
+            if (last > mesh.vertexArray.size())
+                break;
+            found = true;
+            for (uint32_t i = first + 1; i + 1 < last; ++i) {
+                float distance;
+                if (intersectTriangle(origin, direction, vertex(mesh.vertexArray[first]), vertex(mesh.vertexArray[i]), vertex(mesh.vertexArray[i + 1]), distance) && distance < hit.distance) {
+                    hit = { item.node, distance, uint32_t(f) };
+                }
+            }
+        }
+        float distance;
+        if (found == false && intersectBounds(item.node->bounds, origin, inverse, hit.distance, distance)) {
+            hit = { item.node, distance, UINT32_MAX };
+        }
+    };
+
+    auto* previous = hit.node;
+    std::vector<uint32_t> stack = { 0 };
+    while (stack.empty() == false) {
+        auto& node = nodes[stack.back()];
+        stack.pop_back();
+        float distance;
+        if (intersectBounds(node.bounds, origin, inverse, hit.distance, distance) == false)
+            continue;
+        if (node.count) {
+            for (uint32_t i = node.index; i < node.index + node.count; ++i) {
+                intersectItem(items[i]);
+            }
+            continue;
+        }
+        stack.push_back(node.index + 1);
+        stack.push_back(node.index);
+    }
+    return hit.node != previous;
+}
+
+void miMaxBVH::query(miMaxBounds const& bounds, std::vector<miMaxNode const*>& output) const
+{
+    auto overlap = [&](miMaxBounds const& other) {
+        for (int i = 0; i < 3; ++i) {
+            if (other.maximum[i] < bounds.minimum[i] || other.minimum[i] > bounds.maximum[i])
+                return false;
+        }
+        return true;
+    };
+
+    if (nodes.empty())
+        return;
+    std::vector<uint32_t> stack = { 0 };
+    while (stack.empty() == false) {
+        auto& node = nodes[stack.back()];
+        stack.pop_back();
+        if (overlap(node.bounds) == false)
+            continue;
+        if (node.count) {
+            for (uint32_t i = node.index; i < node.index + node.count; ++i) {
+                if (overlap(items[i].node->bounds))
+                    output.push_back(items[i].node);
+            }
+            continue;
+        }
+        stack.push_back(node.index + 1);
+        stack.push_back(node.index);
+    }
+}
+
+void miMAXSweepSpline(miMaxSpline const& path, miMaxSpline const& profile, miMaxMesh& mesh)
+{
+    // Splines built by hand are sampled with the default flatness
+    miMaxSpline sampledPath;
+    miMaxSpline sampledProfile;
+    auto sampled = [](miMaxSpline const& spline, miMaxSpline& copy) -> miMaxSpline const& {
+        if (spline.point.empty() == false || spline.knot.empty())
+            return spline;
+        copy = spline;
+        sampleSpline(copy, miMaxSpline::defaultFlatness);
+        return copy;
+    };
+    auto& pathPoints = sampled(path, sampledPath);
+    auto& profilePoints = sampled(profile, sampledProfile);
+
+    auto sub = [](Point3 const& a, Point3 const& b) { return Point3{ a[0] - b[0], a[1] - b[1], a[2] - b[2] }; };
+    auto dot = [](Point3 const& a, Point3 const& b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; };
+    auto cross = [](Point3 const& a, Point3 const& b) { return Point3{ a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] }; };
+    auto normalize = [&](Point3 const& a) {
+        float length = sqrtf(dot(a, a));
+        return length > 0.0f ? Point3{ a[0] / length, a[1] / length, a[2] / length } : a;
+    };
+    auto reflect = [&](Point3 const& a, Point3 const& normal, float length) {
+        float scale = 2.0f * dot(normal, a) / length;
+        return Point3{ a[0] - normal[0] * scale, a[1] - normal[1] * scale, a[2] - normal[2] * scale };
+    };
+
+    for (size_t i = 0; i + 1 < pathPoints.pointOffset.size(); ++i) {
+        uint32_t begin = pathPoints.pointOffset[i];
+        uint32_t count = pathPoints.pointOffset[i + 1] - begin;
+        if (count < 2)
+            continue;
+        Point3 const* points = &pathPoints.point[begin];
+        bool closed = pathPoints.closed[i] && count > 3;
+
+        // Rotation minimizing frames by double reflection, profile X follows right and profile Y follows up
+        std::vector<Point3> tangent(count);
+        std::vector<Point3> right(count);
+        for (uint32_t j = 0; j < count; ++j) {
+            uint32_t previous = j > 0 ? j - 1 : (closed ? count - 2 : 0);
+            uint32_t next = j + 1 < count ? j + 1 : (closed ? 1 : count - 1);
+            tangent[j] = normalize(sub(points[next], points[previous]));
+        }
+        right[0] = normalize(cross(tangent[0], { 0, 0, 1 }));
+        if (dot(right[0], right[0]) == 0.0f)
+            right[0] = normalize(cross(tangent[0], { 0, 1, 0 }));
+        for (uint32_t j = 0; j + 1 < count; ++j) {
+            Point3 v1 = sub(points[j + 1], points[j]);
+            float c1 = dot(v1, v1);
+            if (c1 == 0.0f) {
+                right[j + 1] = right[j];
+                continue;
+            }
+            Point3 rightL = reflect(right[j], v1, c1);
+            Point3 tangentL = reflect(tangent[j], v1, c1);
+            Point3 v2 = sub(tangent[j + 1], tangentL);
+            float c2 = dot(v2, v2);
+            right[j + 1] = c2 > 0.0f ? reflect(rightL, v2, c2) : rightL;
+        }
+
+        for (size_t k = 0; k + 1 < profilePoints.pointOffset.size(); ++k) {
+            uint32_t profileBegin = profilePoints.pointOffset[k];
+            uint32_t profileEnd = profilePoints.pointOffset[k + 1];
+            bool profileClosed = profilePoints.closed[k] && profileEnd - profileBegin > 3;
+            size_t ringSize = profileClosed ? profileEnd - profileBegin - 1 : profileEnd - profileBegin;
+            if (ringSize < 2)
+                continue;
+            sweepRings(mesh, count, ringSize, profileClosed, 0, [&](size_t ring, size_t index) {
+                auto& shape = profilePoints.point[profileBegin + index];
+                Point3 up = cross(right[ring], tangent[ring]);
+                Point3 point = points[ring];
+                for (int c = 0; c < 3; ++c) {
+                    point[c] += right[ring][c] * shape[0] + up[c] * shape[1];
+                }
+                return point;
+            });
+        }
+    }
+
+    static constexpr float pi = 3.14159265358979f;
+    smoothMesh(mesh, true, pi / 6.0f, 0);
+    mesh.materialRange.clear();
+    mesh.normal.clear();
+    mesh.normalIndex.clear();
+    sortMaterial(mesh);
+    generateNormal(mesh);
+    getBounds(mesh);
+}
+
+void miMAXPackSkin(miMaxSkin const& skin, std::vector<std::array<uint16_t, 4>>& bone, std::vector<std::array<uint8_t, 4>>& weight)
+{
+    size_t vertexCount = skin.weightOffset.empty() ? 0 : skin.weightOffset.size() - 1;
+    bone.assign(vertexCount, {});
+    weight.assign(vertexCount, {});
+    parallelFor(vertexCount, 16384, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            uint32_t top[4] = {};
+            float value[4] = {};
+            for (uint32_t j = skin.weightOffset[i]; j < skin.weightOffset[i + 1]; ++j) {
+                float w = skin.weightValue[j];
+                for (int k = 0; k < 4; ++k) {
+                    if (w <= value[k])
+                        continue;
+                    for (int l = 3; l > k; --l) {
+                        top[l] = top[l - 1];
+                        value[l] = value[l - 1];
+                    }
+                    top[k] = skin.weightBone[j];
+                    value[k] = w;
+                    break;
+                }
+            }
+            float total = value[0] + value[1] + value[2] + value[3];
+            if (total <= 0.0f)
+                continue;
+            // The rounding remainder goes to the largest weight, which can always absorb it
+            int quantized[4];
+            int remain = 255;
+            for (int k = 0; k < 4; ++k) {
+                quantized[k] = int(value[k] / total * 255.0f + 0.5f);
+                remain -= quantized[k];
+            }
+            quantized[0] += remain;
+            for (int k = 0; k < 4; ++k) {
+                bone[i][k] = uint16_t(top[k]);
+                weight[i][k] = uint8_t(quantized[k]);
+            }
         }
-        checkClass(log, *pParamBlock, {}, 0);
-        break;
-    case class64(PLANE_CLASS_ID):
-        if (paramBlock.size() > 3) {
-            float length = std::get<float>(paramBlock[0]);
-            float width = std::get<float>(paramBlock[1]);
-            int lengthSegments = std::get<int>(paramBlock[2]);
-            int widthSegments = std::get<int>(paramBlock[3]);
+    });
+}
 
-            node.vertex = {
-                { -length, -width, 0 },
-                {  length, -width, 0 },
-                { -length,  width, 0 },
-                {  length,  width, 0 },
-            };
+// 64-bit offsets, long is 32-bit on Windows
+static int seekFile(FILE* file, uint64_t offset, int origin)
+{
+#if defined(_WIN32)
+    return _fseeki64(file, int64_t(offset), origin);
+#else
+    return fseeko(file, off_t(offset), origin);
+#endif
+}
 
-            node.text += format("Primitive : %s", "Plane") + '\n';
-            node.text += format("Length : %f", length) + '\n';
-            node.text += format("Width : %f", width) + '\n';
-            node.text += format("Length Segments : %d", lengthSegments) + '\n';
-            node.text += format("Width Segments : %d", widthSegments) + '\n';
-            return;
+static int64_t tellFile(FILE* file)
+{
+#if defined(_WIN32)
+    return _ftelli64(file);
+#else
+    return int64_t(ftello(file));
+#endif
+}
+
+#pragma pack(push, 1)
+struct CompoundFileHeader
+{
+    uint8_t signature[8];
+    uint8_t unused_clsid[16];
+    uint16_t minorVersion;
+    uint16_t majorVersion;
+    uint16_t byteOrder;
+    uint16_t sectorShift;
+    uint16_t miniSectorShift;
+    uint8_t reserved[6];
+    uint32_t numDirectorySector;
+    uint32_t numFATSector;
+    uint32_t firstDirectorySectorLocation;
+    uint32_t transactionSignatureNumber;
+    uint32_t miniStreamCutoffSize;
+    uint32_t firstMiniFATSectorLocation;
+    uint32_t numMiniFATSector;
+    uint32_t firstDIFATSectorLocation;
+    uint32_t numDIFATSector;
+    uint32_t headerDIFAT[109];
+};
+
+struct CompoundFileEntry
+{
+    uint16_t name[32];
+    uint16_t nameLen;
+    uint8_t type;
+    uint8_t colorFlag;
+    uint32_t leftSiblingID;
+    uint32_t rightSiblingID;
+    uint32_t childID;
+    uint8_t clsid[16];
+    uint32_t stateBits;
+    uint64_t creationTime;
+    uint64_t modifiedTime;
+    uint32_t startSectorLocation;
+    uint64_t size;
+};
+#pragma pack(pop)
+static_assert(sizeof(CompoundFileHeader) == 512);
+static_assert(sizeof(CompoundFileEntry) == 128);
+
+struct CompoundFile
+{
+    char const* buffer = nullptr;
+    size_t size = 0;
+    size_t sectorSize = 0;
+    size_t miniSectorSize = 0;
+    size_t miniStreamCutoffSize = 0;
+    miMaxSectorChain chain;
+    std::vector<uint32_t> miniFat;
+    std::vector<CompoundFileEntry> entries;
+    Stream miniStream;
+};
+
+bool miMaxSectorChain::open(void const* data)
+{
+    CompoundFileHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.sectorShift < 7 || header.sectorShift > 16)
+        return false;
+    sectorSize = size_t(1) << header.sectorShift;
+    numFATSector = uint32_t(std::min<uint64_t>(header.numFATSector, fileSize / sectorSize));
+    difat = header.firstDIFATSectorLocation;
+    fatLocations.assign(header.headerDIFAT, header.headerDIFAT + std::min<uint32_t>(numFATSector, 109));
+    fatSectors.clear();
+    return true;
+}
+
+bool miMaxSectorChain::load(uint64_t offset, void* data, size_t length)
+{
+    if (read)
+        return read(offset, data, length);
+    if (buffer == nullptr || offset > fileSize || length > fileSize - offset)
+        return false;
+    memcpy(data, buffer + offset, length);
+    return true;
+}
+
+uint32_t miMaxSectorChain::next(uint32_t sector)
+{
+    size_t sectorCount = sectorSize / sizeof(uint32_t);
+    size_t index = sectorCount ? sector / sectorCount : SIZE_MAX;
+    if (index >= numFATSector)
+        return UINT32_MAX;
+    while (fatLocations.size() <= index) {
+        // FAT sectors past the first 109 are listed by the DIFAT chain, the last entry links the next DIFAT sector
+        if (difat >= 0xFFFFFFFA)
+            return UINT32_MAX;
+        std::vector<uint32_t> entries(sectorCount);
+        if (load((uint64_t(difat) + 1) * sectorSize, entries.data(), sectorSize) == false)
+            return UINT32_MAX;
+        difat = entries.back();
+        fatLocations.insert(fatLocations.end(), entries.begin(), entries.end() - 1);
+    }
+    if (fatSectors.size() <= index)
+        fatSectors.resize(index + 1);
+    auto& entries = fatSectors[index];
+    if (entries.empty()) {
+        uint32_t location = fatLocations[index];
+        entries.resize(sectorCount);
+        if (location >= 0xFFFFFFFA || load((uint64_t(location) + 1) * sectorSize, entries.data(), sectorSize) == false) {
+            entries.clear();
+            return UINT32_MAX;
         }
-        checkClass(log, *pParamBlock, {}, 0);
-        break;
-    case class64(EDITTRIOBJ_CLASS_ID): {
-        auto* pPolyChunk = getChunk(*pChunk, 0x08FE);
-        if (pPolyChunk == nullptr)
+    }
+    return entries[sector % sectorCount];
+}
+
+bool miMaxSectorChain::walk(uint32_t sector, uint64_t size, std::vector<uint64_t>& offsets)
+{
+    // Size is UINT64_MAX when the chain is terminated by ENDOFCHAIN only
+    uint64_t limit = uint64_t(numFATSector) * (sectorSize / sizeof(uint32_t));
+    uint64_t remaining = size;
+    for (uint64_t step = 0; remaining; ++step) {
+        if (sector == 0xFFFFFFFE && size == UINT64_MAX)
             break;
-        auto& polyChunk = (*pPolyChunk);
+        if (sector >= limit || step >= limit)
+            return false;
+        uint64_t offset = (uint64_t(sector) + 1) * sectorSize;
+        uint64_t length = std::min<uint64_t>(sectorSize, remaining);
+        if (offset + length > fileSize)
+            return false;
+        offsets.push_back(offset);
+        if (size != UINT64_MAX)
+            remaining -= length;
+        sector = next(sector);
+    }
+    return true;
+}
 
-        auto vertexArray = getProperty<int>(polyChunk, 0x0912);
-        for (size_t i = 1; i + 4 < vertexArray.size(); i += 5) {
-            node.vertexArray.push_back({});
-            node.vertexArray.back().push_back(vertexArray[i]);
-            node.vertexArray.back().push_back(vertexArray[i + 1]);
-            node.vertexArray.back().push_back(vertexArray[i + 2]);
-        }
+static bool getSectorRuns(CompoundFile& cfb, uint32_t sector, uint64_t size, std::vector<std::pair<size_t, size_t>>& runs)
+{
+    std::vector<uint64_t> offsets;
+    if (cfb.chain.walk(sector, size, offsets) == false)
+        return false;
+    uint64_t remaining = size;
+    for (uint64_t offset : offsets) {
+        size_t length = size_t(std::min<uint64_t>(cfb.sectorSize, remaining));
+        if (runs.empty() == false && runs.back().first + runs.back().second == offset)
+            runs.back().second += length;
+        else
+            runs.emplace_back(size_t(offset), length);
+        if (size != UINT64_MAX)
+            remaining -= length;
+    }
+    return true;
+}
 
-        auto vertex = getProperty<float>(polyChunk, 0x0914);
-        for (size_t i = 1; i + 2 < vertex.size(); i += 3) {
-            node.vertex.push_back({vertex[i], vertex[i + 1], vertex[i + 2]});
+static void gatherRuns(CompoundFile const& cfb, std::vector<std::pair<size_t, size_t>> const& runs, Stream& stream)
+{
+    if (runs.size() == 1) {
+        stream.data = cfb.buffer + runs.front().first;
+        stream.size = runs.front().second;
+        return;
+    }
+    std::vector<size_t> positions(runs.size() + 1);
+    for (size_t i = 0; i < runs.size(); ++i) {
+        positions[i + 1] = positions[i] + runs[i].second;
+    }
+    stream.storage.resize(positions.back());
+    stream.data = stream.storage.data();
+    stream.size = stream.storage.size();
+    parallelFor(runs.size(), 256, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            memcpy(stream.storage.data() + positions[i], cfb.buffer + runs[i].first, runs[i].second);
         }
+    });
+}
+
+static void maskEntrySizes(CompoundFileHeader const& header, std::vector<CompoundFileEntry>& entries)
+{
+    // Version 3 writers may leave garbage in the high 32 bits of the stream size
+    if (header.majorVersion != 3)
+        return;
+    for (auto& entry : entries) {
+        entry.size &= 0xFFFFFFFFull;
+    }
+}
+
+static bool openCompoundFile(CompoundFile& cfb, char const* buffer, size_t size)
+{
+    static uint8_t const signature[8] = { 0xD0, 0xCF, 0x11, 0xE0, 0xA1, 0xB1, 0x1A, 0xE1 };
+
+    CompoundFileHeader header;
+    if (size < sizeof(header))
+        return false;
+    memcpy(&header, buffer, sizeof(header));
+    if (memcmp(header.signature, signature, sizeof(signature)) != 0)
+        return false;
+    if (header.sectorShift < 7 || header.sectorShift > 16 || header.miniSectorShift >= header.sectorShift)
+        return false;
+    cfb.buffer = buffer;
+    cfb.size = size;
+    cfb.sectorSize = size_t(1) << header.sectorShift;
+    cfb.miniSectorSize = size_t(1) << header.miniSectorShift;
+    cfb.miniStreamCutoffSize = header.miniStreamCutoffSize;
+    cfb.chain.buffer = buffer;
+    cfb.chain.fileSize = size;
+    if (cfb.chain.open(&header) == false)
+        return false;
 
-        auto texture = getProperty<float>(polyChunk, 0x0916);
-        if (texture.empty())
-            texture = getProperty<float>(polyChunk, 0x2394);
-        for (size_t i = 1; i + 2 < texture.size(); i += 3) {
-            node.texture.push_back({texture[i], texture[i + 1], texture[i + 2]});
+    // Directory
+    std::vector<std::pair<size_t, size_t>> runs;
+    if (getSectorRuns(cfb, header.firstDirectorySectorLocation, UINT64_MAX, runs) == false)
+        return false;
+    Stream directory;
+    gatherRuns(cfb, runs, directory);
+    cfb.entries.resize(directory.size / sizeof(CompoundFileEntry));
+    if (cfb.entries.empty())
+        return false;
+    memcpy(cfb.entries.data(), directory.data, cfb.entries.size() * sizeof(CompoundFileEntry));
+    maskEntrySizes(header, cfb.entries);
+
+    // Mini stream and MiniFAT
+    auto& rootEntry = cfb.entries.front();
+    if (rootEntry.size) {
+        runs.clear();
+        if (getSectorRuns(cfb, rootEntry.startSectorLocation, rootEntry.size, runs) == false)
+            return false;
+        gatherRuns(cfb, runs, cfb.miniStream);
+    }
+    if (header.numMiniFATSector) {
+        runs.clear();
+        if (getSectorRuns(cfb, header.firstMiniFATSectorLocation, UINT64_MAX, runs) == false)
+            return false;
+        Stream miniFat;
+        gatherRuns(cfb, runs, miniFat);
+        cfb.miniFat.resize(miniFat.size / sizeof(uint32_t));
+        memcpy(cfb.miniFat.data(), miniFat.data, cfb.miniFat.size() * sizeof(uint32_t));
+    }
+
+    return true;
+}
+
+static bool readStream(CompoundFile& cfb, CompoundFileEntry const& entry, Stream& stream)
+{
+    // Streams below the cutoff live in the mini stream
+    if (entry.size < cfb.miniStreamCutoffSize) {
+        stream.storage.resize(size_t(entry.size));
+        stream.data = stream.storage.data();
+        stream.size = stream.storage.size();
+        uint32_t sector = entry.startSectorLocation;
+        for (size_t position = 0, step = 0; position < stream.size; ++step) {
+            size_t offset = size_t(sector) * cfb.miniSectorSize;
+            size_t length = std::min<size_t>(cfb.miniSectorSize, stream.size - position);
+            if (sector >= cfb.miniFat.size() || step >= cfb.miniFat.size() || offset + length > cfb.miniStream.size)
+                return false;
+            memcpy(stream.storage.data() + position, cfb.miniStream.data + offset, length);
+            position += length;
+            sector = cfb.miniFat[sector];
         }
+        return true;
+    }
+
+    std::vector<std::pair<size_t, size_t>> runs;
+    if (getSectorRuns(cfb, entry.startSectorLocation, entry.size, runs) == false)
+        return false;
+    gatherRuns(cfb, runs, stream);
+    return true;
+}
+
+static std::string getEntryName(CompoundFileEntry const& entry)
+{
+    uint16_t entryName[32];
+    memcpy(entryName, entry.name, sizeof(entryName));
+    size_t length = std::min<size_t>(entry.nameLen / sizeof(uint16_t), 32);
+    while (length && entryName[length - 1] == 0)
+        length--;
+    return UTF16ToUTF8(entryName, length);
+}
+
+static char const* getVersionName(uint16_t type)
+{
+    switch (type) {
+    case 0x200E:    return "3ds Max 9";
+    case 0x200F:    return "3ds Max 2008";
+    case 0x2012:    return "3ds Max 2010";
+    case 0x2020:    return "3ds Max 2015";
+    case 0x2023:    return "3ds Max 2018";
+    }
+    return "";
+}
+
+// Sectors are read on demand, so a probe only touches the header, the FAT sectors on its way,
+// the directory and the head of each stream
+struct ProbeStream
+{
+    uint32_t start = 0;
+    uint64_t size = 0;
+    bool mini = false;
+    uint64_t index = 0;         // Cursor in sectors of the stream
+    uint32_t sector = 0;
 
-        auto textureArray = getProperty<int>(polyChunk, 0x0918);
-        if (textureArray.empty())
-            textureArray = getProperty<int>(polyChunk, 0x2396);
-        for (size_t i = 1; i + 2 < textureArray.size(); i += 3) {
-            node.textureArray.push_back({});
-            node.textureArray.back().push_back(textureArray[i]);
-            node.textureArray.back().push_back(textureArray[i + 1]);
-            node.textureArray.back().push_back(textureArray[i + 2]);
+    ProbeStream(uint32_t start = 0, uint64_t size = 0, bool mini = false) : start(start), size(size), mini(mini), sector(start) {}
+};
+
+struct ProbeFile
+{
+    FILE* file = nullptr;
+    uint64_t size = 0;
+    uint64_t bytesRead = 0;
+    CompoundFileHeader header = {};
+    size_t sectorSize = 0;
+    size_t miniSectorSize = 0;
+    miMaxSectorChain chain;
+    ProbeStream miniFat;
+    ProbeStream miniStream;
+    std::vector<char> block;
+    uint64_t blockOffset = UINT64_MAX;
+
+    ~ProbeFile()
+    {
+        if (file) {
+            fclose(file);
         }
+    }
 
-        if (node.vertexArray.size() && node.textureArray.size()) {
-            if (node.vertexArray.size() != node.textureArray.size()) {
-                log("%s is corrupted (%zd:%zd)", "Editable Mesh", node.vertexArray.size(), node.textureArray.size());
+    bool read(uint64_t offset, void* data, size_t length)
+    {
+        char* output = (char*)data;
+        while (length) {
+            uint64_t aligned = offset - offset % block.size();
+            if (aligned != blockOffset) {
+                if (aligned >= size || seekFile(file, aligned, SEEK_SET) != 0)
+                    return false;
+                size_t count = size_t(std::min<uint64_t>(block.size(), size - aligned));
+                if (fread(block.data(), 1, count, file) != count)
+                    return false;
+                blockOffset = aligned;
+                bytesRead += count;
             }
+            size_t inner = size_t(offset - aligned);
+            size_t count = std::min(block.size() - inner, length);
+            if (aligned + inner + count > size)
+                return false;
+            memcpy(output, block.data() + inner, count);
+            output += count;
+            offset += count;
+            length -= count;
         }
+        return true;
+    }
+};
 
-        size_t totalVertexArray = 0;
-        size_t totalTextureArray = 0;
-        for (auto& array : node.vertexArray) {
-            totalVertexArray += array.size();
+static bool readProbeStream(ProbeFile& file, ProbeStream& stream, uint64_t offset, void* data, size_t length)
+{
+    if (offset > stream.size || length > stream.size - offset)
+        return false;
+    size_t unit = stream.mini ? file.miniSectorSize : file.sectorSize;
+    char* output = (char*)data;
+    while (length) {
+        uint64_t index = offset / unit;
+        if (index < stream.index) {
+            stream.index = 0;
+            stream.sector = stream.start;
         }
-        for (auto& array : node.textureArray) {
-            totalTextureArray += array.size();
+        while (stream.index < index) {
+            uint32_t next = UINT32_MAX;
+            if (stream.mini == false)
+                next = file.chain.next(stream.sector);
+            else if (readProbeStream(file, file.miniFat, uint64_t(stream.sector) * sizeof(uint32_t), &next, sizeof(uint32_t)) == false)
+                return false;
+            if (next >= 0xFFFFFFFA)
+                return false;
+            stream.sector = next;
+            stream.index++;
         }
-
-        node.text += format("Primitive : %s", "Editable Mesh") + '\n';
-        node.text += format("Vertex : %zd", node.vertex.size()) + '\n';
-        node.text += format("Texture : %zd", node.texture.size()) + '\n';
-        node.text += format("Vertex Array : %zd (%zd)", node.vertexArray.size(), totalVertexArray) + '\n';
-        node.text += format("Texture Array : %zd (%zd)", node.textureArray.size(), totalTextureArray) + '\n';
-        return;
+        if (stream.sector >= 0xFFFFFFFA)
+            return false;
+        size_t inner = size_t(offset % unit);
+        size_t count = std::min<size_t>(unit - inner, length);
+        uint64_t position = uint64_t(stream.sector) * unit + inner;
+        if (stream.mini ? readProbeStream(file, file.miniStream, position, output, count) == false
+                        : file.read(position + file.sectorSize, output, count) == false)
+            return false;
+        output += count;
+        offset += count;
+        length -= count;
     }
-    case class64(EPOLYOBJ_CLASS_ID): {
-        auto* pPolyChunk = getChunk(*pChunk, 0x08FE);
-        if (pPolyChunk == nullptr)
-            break;
-        auto& polyChunk = (*pPolyChunk);
+    return true;
+}
 
-        auto vertex = getProperty<float>(polyChunk, 0x0100);
-        for (size_t i = 1; i + 3 < vertex.size(); i += 4) {
-            node.vertex.push_back({vertex[i + 1], vertex[i + 2], vertex[1 + 3]});
+template <typename F>
+static bool walkProbeScene(F&& read, uint64_t budget, miMaxProbe& probe)
+{
+    // Chunk headers are 6 bytes, or 14 bytes when the 32-bit length is zero
+    auto header = [&](uint64_t offset, uint16_t& type, uint64_t& length, uint64_t& size) {
+        char data[14];
+        if (read(offset, data, 6) == false)
+            return false;
+        length = 0;
+        memcpy(&type, data, 2);
+        memcpy(&length, data + 2, 4);
+        size = 6;
+        if (length == 0) {
+            if (read(offset + 6, data + 6, 8) == false)
+                return false;
+            memcpy(&length, data + 6, 8);
+            size = 14;
+            length &= 0x7FFFFFFFFFFFFFFFull;
         }
-
-        auto vertexArray = getProperty<uint16_t>(polyChunk, 0x011A);
-        for (size_t i = 2; i + 1 < vertexArray.size(); i += 2) {
-            uint32_t count = (vertexArray[i] | vertexArray[i + 1] << 16) * 2;
-            if (i + 2 + count + 1 > vertexArray.size()) {
-                log("%s is corrupted", "Editable Poly");
-                break;
-            }
-            i += 2;
-            node.vertexArray.push_back({});
-            for (size_t j = i, list = i + count; j < list; j += 2) {
-                node.vertexArray.back().push_back(vertexArray[j] | vertexArray[j + 1] << 16);
-            }
-            i += count;
-            uint16_t flags = vertexArray[i];
-            i += 1;
-            if (flags & 0x01)   i += 2;
-            if (flags & 0x08)   i += 1;
-            if (flags & 0x10)   i += 2;
-            if (flags & 0x20)   i += 2 * (count - 6);
-            i -= 2;
+        else {
+            length &= 0x7FFFFFFFull;
         }
+        return length >= size;
+    };
 
-        auto texture = getProperty<float>(polyChunk, 0x0128);
-        for (size_t i = 1; i + 2 < texture.size(); i += 3) {
-            node.texture.push_back({texture[i], texture[i + 1], texture[1 + 2]});
-        }
+    uint16_t type;
+    uint64_t length;
+    uint64_t size;
+    if (header(0, type, length, size) == false)
+        return false;
+    probe.sceneType = type;
+    probe.version = getVersionName(type);
 
-        auto textureArray = getProperty<uint32_t>(polyChunk, 0x012B);
-        for (size_t i = 0; i < textureArray.size(); ++i) {
-            uint32_t count = textureArray[i];
-            if (i + 1 + count > textureArray.size()) {
-                log("%s is corrupted", "Editable Poly");
-                break;
-            }
-            i += 1;
-            node.textureArray.push_back({});
-            for (size_t j = i, list = i + count; j < list; ++j) {
-                node.textureArray.back().push_back(textureArray[j]);
-            }
-            i += count;
-            i -= 1;
+    // Top-level chunks past the budget are extrapolated from the average chunk length so far
+    uint64_t begin = size;
+    uint64_t end = length;
+    uint64_t offset = begin;
+    uint64_t count = 0;
+    probe.sceneExact = true;
+    while (offset < end) {
+        if (budget == 0) {
+            probe.sceneExact = false;
+            break;
         }
+        budget--;
+        uint64_t childLength;
+        uint64_t childSize;
+        if (header(offset, type, childLength, childSize) == false || childLength > end - offset) {
+            probe.sceneExact = false;
+            break;
+        }
+        offset += childLength;
+        count++;
+    }
+    probe.sceneChunks = count;
+    if (probe.sceneExact == false && offset > begin) {
+        probe.sceneChunks = uint64_t(double(count) * double(end - begin) / double(offset - begin));
+    }
+    return true;
+}
 
-        if (node.vertexArray.size() && node.textureArray.size()) {
-            bool corrupted = (node.vertexArray.size() != node.textureArray.size());
-            if (corrupted == false) {
-                for (size_t i = 0; i < node.vertexArray.size() && i < node.textureArray.size(); ++i) {
-                    if (node.vertexArray[i].size() != node.textureArray[i].size()) {
-                        corrupted = true;
-                        break;
-                    }
-                }
-            }
-            if (corrupted) {
-                log("%s is corrupted (%zd:%zd)", "Editable Poly", node.vertexArray.size(), node.textureArray.size());
-            }
+miMaxError miMAXProbeFile(char const* name, miMaxProbe& probe)
+{
+    probe = {};
+
+    ProbeFile file;
+    file.file = fopen(name, "rb");
+    if (file.file == nullptr)
+        return probe.error = MIMAX_FILE_NOT_FOUND;
+    setvbuf(file.file, nullptr, _IONBF, 0);
+    seekFile(file.file, 0, SEEK_END);
+    int64_t tell = tellFile(file.file);
+    if (tell < 0)
+        return probe.error = MIMAX_FILE_NOT_READABLE;
+    file.size = uint64_t(tell);
+    probe.fileSize = file.size;
+
+    // Header
+    static uint8_t const signature[8] = { 0xD0, 0xCF, 0x11, 0xE0, 0xA1, 0xB1, 0x1A, 0xE1 };
+    auto& header = file.header;
+    file.block.resize(sizeof(CompoundFileHeader));
+    if (file.read(0, &header, sizeof(header)) == false || memcmp(header.signature, signature, sizeof(signature)) != 0)
+        return probe.error = MIMAX_FILE_NOT_COMPOUND;
+    if (header.sectorShift < 7 || header.sectorShift > 16 || header.miniSectorShift >= header.sectorShift)
+        return probe.error = MIMAX_FILE_NOT_COMPOUND;
+    file.sectorSize = size_t(1) << header.sectorShift;
+    file.miniSectorSize = size_t(1) << header.miniSectorShift;
+    file.block.resize(file.sectorSize);
+    file.blockOffset = UINT64_MAX;
+    file.chain.fileSize = file.size;
+    file.chain.read = [&file](uint64_t offset, void* data, size_t length) {
+        return file.read(offset, data, length);
+    };
+    file.chain.open(&header);
+    file.miniFat = ProbeStream(header.firstMiniFATSectorLocation, uint64_t(header.numMiniFATSector) * file.sectorSize);
+
+    // Directory
+    std::vector<CompoundFileEntry> entries;
+    ProbeStream directory(header.firstDirectorySectorLocation, UINT64_MAX);
+    for (uint64_t offset = 0;; offset += sizeof(CompoundFileEntry)) {
+        CompoundFileEntry entry;
+        if (readProbeStream(file, directory, offset, &entry, sizeof(entry)) == false)
+            break;
+        if (entries.size() == 4096) {
+            probe.directoryTruncated = true;
+            break;
         }
+        entries.push_back(entry);
+    }
+    if (entries.empty())
+        return probe.error = MIMAX_FILE_NOT_COMPOUND;
+    maskEntrySizes(header, entries);
+    file.miniStream = ProbeStream(entries.front().startSectorLocation, entries.front().size);
 
-        size_t totalVertexArray = 0;
-        size_t totalTextureArray = 0;
-        for (auto& array : node.vertexArray) {
-            totalVertexArray += array.size();
+    // Streams
+    ProbeStream scene;
+    bool sceneFound = false;
+    for (auto& entry : entries) {
+        if (entry.type != 2)
+            continue;
+        miMaxProbe::Stream stream;
+        stream.name = getEntryName(entry);
+        stream.size = entry.size;
+        ProbeStream probeStream(entry.startSectorLocation, entry.size, entry.size < header.miniStreamCutoffSize);
+        uint8_t magic[2] = {};
+        if (entry.size >= 2 && readProbeStream(file, probeStream, 0, magic, sizeof(magic))) {
+            stream.compressed = (magic[0] == 0x1F && magic[1] == 0x8B);
         }
-        for (auto& array : node.textureArray) {
-            totalTextureArray += array.size();
+        if (stream.name == "Scene") {
+            scene = probeStream;
+            sceneFound = entry.size != 0;
+            probe.sceneCompressed = stream.compressed;
         }
+        probe.streams.push_back(std::move(stream));
+    }
+    if (sceneFound == false) {
+        probe.bytesRead = file.bytesRead;
+        return probe.error = MIMAX_SCENE_EMPTY;
+    }
 
-        node.text += format("Primitive : %s", "Editable Poly") + '\n';
-        node.text += format("Vertex : %zd", node.vertex.size()) + '\n';
-        node.text += format("Texture : %zd", node.texture.size()) + '\n';
-        node.text += format("Vertex Array : %zd (%zd)", node.vertexArray.size(), totalVertexArray) + '\n';
-        node.text += format("Texture Array : %zd (%zd)", node.textureArray.size(), totalTextureArray) + '\n';
-        return;
+    // Scene
+    static constexpr uint64_t budget = 256;
+    bool walked = false;
+    if (probe.sceneCompressed == false) {
+        walked = walkProbeScene([&](uint64_t offset, void* data, size_t length) {
+            return readProbeStream(file, scene, offset, data, length);
+        }, budget, probe);
     }
-    default:
-        break;
+#if defined(__APPLE__)
+    else {
+        // Only a prefix is inflated, enough for the root header and the first chunks
+        std::vector<char> input(size_t(std::min<uint64_t>(scene.size, 16384)));
+        std::vector<char> output(65536);
+        if (readProbeStream(file, scene, 0, input.data(), input.size())) {
+            z_stream z = {};
+            z.next_in = (Bytef*)input.data();
+            z.avail_in = (uInt)input.size();
+            z.next_out = (Bytef*)output.data();
+            z.avail_out = (uInt)output.size();
+            inflateInit2(&z, MAX_WBITS | 32);
+            int result = inflate(&z, Z_SYNC_FLUSH);
+            output.resize(result == Z_OK || result == Z_STREAM_END || result == Z_BUF_ERROR ? z.total_out : 0);
+            inflateEnd(&z);
+        }
+        walked = walkProbeScene([&](uint64_t offset, void* data, size_t length) {
+            if (offset > output.size() || length > output.size() - offset)
+                return false;
+            memcpy(data, output.data() + offset, length);
+            return true;
+        }, budget, probe);
     }
-    checkClass(log, *pChunk, {}, 0);
+#endif
+    probe.bytesRead = file.bytesRead;
+    probe.sceneProbed = walked;
+    if (probe.sceneCompressed && walked == false)
+        return probe.error = MIMAX_OK;
+    if (walked == false)
+        return probe.error = MIMAX_SCENE_EMPTY;
+    if (probe.version[0] == 0 && probe.sceneType < 0x2000)
+        return probe.error = MIMAX_SCENE_NOT_SUPPORTED;
+    return probe.error = MIMAX_OK;
 }
 
-miMaxNode* miMAXOpenFile(char const* name, int(*log)(char const*, ...))
+void miMAXProbeFiles(std::vector<std::string> const& names, std::vector<miMaxProbe>& probes)
 {
-    FILE* file = fopen(name, "rb");
-    if (file == nullptr) {
-        log("File is not found", name);
-        return nullptr;
+    probes.resize(names.size());
+    parallelForEach(names.size(), [&](size_t i) {
+        miMAXProbeFile(names[i].c_str(), probes[i]);
+    });
+}
+
+#if MIMAX_PROFILE
+static bool writeTrace(char const* name, miMaxStats const& stats)
+{
+    FILE* file = fopen(name, "wb");
+    if (file == nullptr)
+        return false;
+
+    uint64_t end = 0;
+    fprintf(file, "{\"traceEvents\":[");
+    for (auto& timer : stats.timers) {
+        fprintf(file, "{\"name\":\"%s\",\"cat\":\"miMAX\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":1,\"tid\":%u},",
+                escapeJSON(timer.name).c_str(), (unsigned long long)timer.begin, (unsigned long long)timer.duration, timer.thread + 1);
+        end = std::max(end, timer.begin + timer.duration);
     }
+    fprintf(file, "{\"name\":\"Counters\",\"cat\":\"miMAX\",\"ph\":\"C\",\"ts\":%llu,\"pid\":1,\"tid\":1,", (unsigned long long)end);
+    fprintf(file, "\"args\":{\"chunks\":%llu,\"links\":%llu,\"propertyBytes\":%llu,\"unknownClasses\":%llu}}",
+            (unsigned long long)stats.chunks, (unsigned long long)stats.links, (unsigned long long)stats.propertyBytes, (unsigned long long)stats.unknownClasses);
+    fprintf(file, "]}\n");
+
+    bool written = ferror(file) == 0;
+    fclose(file);
+    return written;
+}
 
-    miMaxNode* root = nullptr;
+struct ProfileSession : public Profile
+{
+    miMaxReader& reader;
+    Profile* previous = profile;
 
-    TRY
+    ProfileSession(miMaxReader& reader) : reader(reader)
+    {
+        profile = this;
+        profileThread();
+    }
 
-    root = new miMaxNode;
-    if (root == nullptr) {
-        log("Out of memory");
-        THROW;
+    ~ProfileSession()
+    {
+        profile = previous;
+        reader.stats.timers = std::move(timers);
+        reader.stats.chunks = chunks;
+        reader.stats.links = links;
+        reader.stats.propertyBytes = propertyBytes;
+        reader.stats.unknownClasses = unknownClasses;
+        if (reader.trace && writeTrace(reader.trace, reader.stats) == false) {
+            Log log = { &reader };
+            log("Trace is not written (%s)", reader.trace);
+        }
     }
+};
+#define PROFILE_SESSION(reader)         ProfileSession profileSession(reader)
+#else
+#define PROFILE_SESSION(reader)
+#endif
+
+void* miMaxCountingResource::do_allocate(size_t size, size_t alignment)
+{
+    void* pointer = upstream->allocate(size, alignment);
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(size, std::memory_order_relaxed);
+    uint64_t current = bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    uint64_t maximum = peak.load(std::memory_order_relaxed);
+    while (maximum < current && peak.compare_exchange_weak(maximum, current, std::memory_order_relaxed) == false) {}
+    return pointer;
+}
+
+void miMaxCountingResource::do_deallocate(void* pointer, size_t size, size_t alignment)
+{
+    upstream->deallocate(pointer, size, alignment);
+    deallocations.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+bool miMaxCountingResource::do_is_equal(std::pmr::memory_resource const& other) const noexcept
+{
+    return this == &other;
+}
 
-    std::vector<char> dataClassData;
-    std::vector<char> dataClassDirectory;
-    std::vector<char> dataConfig;
-    std::vector<char> dataDllDirectory;
-    std::vector<char> dataScene;
-    std::vector<char> dataVideoPostQueue;
+static miMaxError openFile(miMaxReader& reader, char const* name, std::unique_ptr<miMaxNode>& output, std::pmr::memory_resource* scratch)
+{
+    auto* resource = reader.resource ? reader.resource : std::pmr::get_default_resource();
+    std::mutex mutex;
+    Log log = { &reader, &mutex };
+    reader.diagnostics.clear();
+    reader.stats = {};
+    reader.error = MIMAX_OK;
+    output.reset();
+    PROFILE_SESSION(reader);
+
+    // Serial readers run every parallel loop inline on the calling thread
+    struct Serial
+    {
+        bool nested = parallelSerial;
+        Serial(bool serial) { parallelSerial = nested || serial; }
+        ~Serial() { parallelSerial = nested; }
+    } serial(reader.parallel == false);
+
+    PROFILE_TIMER(timerRead, "Read File");
+    FILE* file = fopen(name, "rb");
+    if (file == nullptr) {
+        log("File is not found (%s)", name);
+        return reader.error = MIMAX_FILE_NOT_FOUND;
+    }
 
-    fseek(file, 0, SEEK_END);
-    size_t size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    std::vector<char> buffer(size);
-    fread(buffer.data(), 1, size, file);
+    seekFile(file, 0, SEEK_END);
+    int64_t tell = tellFile(file);
+    seekFile(file, 0, SEEK_SET);
+    std::pmr::vector<char> buffer(tell > 0 ? size_t(tell) : 0, scratch);
+    size_t size = fread(buffer.data(), 1, buffer.size(), file);
     fclose(file);
-    file = nullptr;
-
-    if (buffer.empty() == false) {
-        CFB::CompoundFileReader cfbReader(buffer.data(), buffer.size());
-        cfbReader.EnumFiles(cfbReader.GetRootEntry(), -1, [&](CFB::COMPOUND_FILE_ENTRY const* entry, CFB::utf16string const& dir, int level) {
-            std::string name = UTF16ToUTF8(entry->name);
-            std::vector<char>* data = nullptr;
-            if (name == "ClassData")            data = &dataClassData;
-            else if (name == "ClassDirectory")  data = &dataClassDirectory;
-            else if (name == "ClassDirectory3") data = &dataClassDirectory;
-            else if (name == "Config")          data = &dataConfig;
-            else if (name == "DllDirectory")    data = &dataDllDirectory;
-            else if (name == "Scene")           data = &dataScene;
-            else if (name == "VideoPostQueue")  data = &dataVideoPostQueue;
-            if (data) {
-                data->resize(entry->size);
-                cfbReader.ReadFile(entry, 0, data->data(), data->size());
-                (*data) = uncompress(*data);
-            }
-        });
+    if (tell < 0 || size != buffer.size()) {
+        log("File is not readable (%s)", name);
+        return reader.error = MIMAX_FILE_NOT_READABLE;
     }
+    PROFILE_STOP(timerRead);
+
+    PROFILE_TIMER(timerCompound, "Compound File");
+    CompoundFile cfb;
+    if (openCompoundFile(cfb, buffer.data(), buffer.size()) == false) {
+        log("File is not a compound file (%s)", name);
+        return reader.error = MIMAX_FILE_NOT_COMPOUND;
+    }
+
+    Stream streamClassData(scratch);
+    Stream streamClassDirectory(scratch);
+    Stream streamConfig(scratch);
+    Stream streamDllDirectory(scratch);
+    Stream streamScene(scratch);
+    Stream streamVideoPostQueue(scratch);
+
+    for (auto& entry : cfb.entries) {
+        if (entry.type != 2)
+            continue;
+        std::string name = getEntryName(entry);
+        Stream* stream = nullptr;
+        if (name == "ClassData")            stream = &streamClassData;
+        else if (name == "ClassDirectory")  stream = &streamClassDirectory;
+        else if (name == "ClassDirectory3") stream = &streamClassDirectory;
+        else if (name == "Config")          stream = &streamConfig;
+        else if (name == "DllDirectory")    stream = &streamDllDirectory;
+        else if (name == "Scene")           stream = &streamScene;
+        else if (name == "VideoPostQueue")  stream = &streamVideoPostQueue;
+        if (stream == nullptr)
+            continue;
+        if (readStream(cfb, entry, *stream) == false) {
+            log("Stream %s is corrupted", name.c_str());
+            return reader.error = MIMAX_FILE_NOT_COMPOUND;
+        }
+        PROFILE_TIMER(timerUncompress, "Uncompress");
+        uncompress(*stream);
+    }
+    PROFILE_STOP(timerCompound);
 
     // Parse
-    root->classData = new Chunk;
-    root->classDirectory = new Chunk;
-    root->config = new Chunk;
-    root->dllDirectory = new Chunk;
-    root->scene = new Chunk;
-    root->videoPostQueue = new Chunk;
-    parseStream(*root->classData, dataClassData.data(), dataClassData.data() + dataClassData.size());
-    parseStream(*root->classDirectory, dataClassDirectory.data(), dataClassDirectory.data() + dataClassDirectory.size());
-    parseStream(*root->config, dataConfig.data(), dataConfig.data() + dataConfig.size());
-    parseStream(*root->dllDirectory, dataDllDirectory.data(), dataDllDirectory.data() + dataDllDirectory.size());
-    parseStream(*root->scene, dataScene.data(), dataScene.data() + dataScene.size());
-    parseStream(*root->videoPostQueue, dataVideoPostQueue.data(), dataVideoPostQueue.data() + dataVideoPostQueue.size());
+    auto parse = [](Chunk& chunk, Stream const& stream, char const* name) {
+        PROFILE_TIMER(timerParse, name);
+        parseStream(chunk, stream.data, stream.data, stream.data + stream.size);
+    };
+    auto root = std::make_unique<miMaxNode>();
+    root->classData = new Chunk(resource);
+    root->classDirectory = new Chunk(resource);
+    root->config = new Chunk(resource);
+    root->dllDirectory = new Chunk(resource);
+    root->scene = new Chunk(resource);
+    root->videoPostQueue = new Chunk(resource);
+    parse(*root->classData, streamClassData, "Parse ClassData");
+    parse(*root->classDirectory, streamClassDirectory, "Parse ClassDirectory");
+    parse(*root->config, streamConfig, "Parse Config");
+    parse(*root->dllDirectory, streamDllDirectory, "Parse DllDirectory");
+    parse(*root->scene, streamScene, "Parse Scene");
+    parse(*root->videoPostQueue, streamVideoPostQueue, "Parse VideoPostQueue");
 
     // Root
     if (root->scene->empty()) {
         log("Scene is empty");
-        THROW;
+        return reader.error = MIMAX_SCENE_EMPTY;
     }
     auto& scene = root->scene->front();
     switch (scene.type) {
@@ -997,96 +5569,189 @@ miMaxNode* miMAXOpenFile(char const* name, int(*log)(char const*, ...))
         if (scene.type >= 0x2000)
             break;
         log("Scene type %04X is not supported", scene.type);
-        THROW;
+        return reader.error = MIMAX_SCENE_NOT_SUPPORTED;
     }
 
+    // Class
+    PROFILE_TIMER(timerClass, "Class Pass");
+    getClassDirectory(*root->classDirectory, root->classes);
+    getDllDirectory(*root->dllDirectory, root->dlls);
+
     // First Pass
     for (uint32_t i = 0; i < scene.size(); ++i) {
         auto& chunk = scene[i];
-        auto [className, classData] = getClass(*root->classDirectory, chunk.type);
-        if (className.empty()) {
+        if (root->classes.size() <= chunk.type || root->classes[chunk.type].name.empty()) {
             if (chunk.type != 0x2032) {
                 log("Class %04X is not found! (Chunk:%X)", chunk.type, i);
+                PROFILE_COUNT(unknownClasses, 1);
             }
             continue;
         }
-        auto [dllFile, dllName] = getDll(*root->dllDirectory, classData.dllIndex);
-        chunk.name = className;
-        chunk.classData = classData;
-        chunk.classDllFile = dllFile;
-        chunk.classDllName = dllName;
+        chunk.classIndex = chunk.type;
     }
 
+    PROFILE_STOP(timerClass);
+
     // Second Pass
-    std::map<uint32_t, miMaxNode*> nodes;
+    PROFILE_TIMER(timerNode, "Node Pass");
+    Context context = { log, scene, root->classes, std::pmr::vector<ParamBlock>(scene.size(), scratch), {}, {}, resource, reader.compact, reader.patchSteps, reader.splineFlatness };
+    // Parameter blocks are decoded up front, so the passes below only read them
+    PROFILE_TIMER(timerParamBlock, "Param Blocks");
+    parallelFor(scene.size(), 4096, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            decodeParamBlock(context, scene[i], context.paramBlocks[i]);
+        }
+    });
+    PROFILE_STOP(timerParamBlock);
+    std::vector<uint32_t> nodeIndices;
+    auto& parents = context.parents;
+    parents.assign(scene.size(), UINT32_MAX);
     for (uint32_t i = 0; i < scene.size(); ++i) {
         auto& chunk = scene[i];
-        auto& className = chunk.name;
-        auto& classData = chunk.classData;
 
         // FFFFFFFF-00000001-00000000-00000001 - Node
         // FFFFFFFF-00000002-00000000-00000001 - RootNode   BASENODE_SUPERCLASS_ID
-        if (classData.superClassID != BASENODE_SUPERCLASS_ID)
+        if (getClassData(context, chunk).superClassID != BASENODE_SUPERCLASS_ID)
             continue;
-
-        miMaxNode node;
+        nodeIndices.push_back(i);
 
         // Parent
-        std::vector<uint32_t> propertyParent = getProperty<uint32_t>(chunk, 0x0960);
-        miMaxNode* parent = root;
-        if (propertyParent.empty() == false) {
-            uint32_t index = *propertyParent.data();
-            miMaxNode* found = nodes[index];
-            if (found) {
-                parent = found;
+        auto* chunkParent = getChunk(chunk, 0x0960);
+        if (chunkParent && chunkParent->property.size() >= sizeof(uint32_t)) {
+            uint32_t index = UINT32_MAX;
+            memcpy(&index, chunkParent->property.data(), sizeof(uint32_t));
+            if (index < scene.size() && getClassData(context, scene[index]).superClassID == BASENODE_SUPERCLASS_ID) {
+                parents[i] = index;
             }
             else {
                 log("Parent %d is not found! (Chunk:%d)", index, i);
             }
         }
+    }
 
-        // Name
-        std::vector<uint16_t> propertyName = getProperty<uint16_t>(chunk, 0x0962);
-        if (propertyName.empty() == false) {
-            node.name = UTF16ToUTF8(propertyName.data(), propertyName.size());
-        }
-        else {
-            node.name = className;
+    // Parents are attached before their children, even when they come later in the Scene
+    std::vector<miMaxNode*> nodes(scene.size());
+    std::vector<uint8_t> visiting(scene.size());
+    std::vector<uint32_t> pending;
+    std::vector<uint32_t> meshIndices;
+    std::vector<uint8_t> queued(scene.size());
+    std::vector<std::pair<miMaxNode*, uint32_t>> nodeMeshes;
+    for (uint32_t nodeIndex : nodeIndices) {
+        for (uint32_t index = nodeIndex; index != UINT32_MAX && nodes[index] == nullptr; index = parents[index]) {
+            if (visiting[index]) {
+                // The last node of the chain closes the cycle, so its edge is the one cut
+                uint32_t last = pending.back();
+                log("Parent %d is cyclic! (Chunk:%d)", parents[last], last);
+                parents[last] = UINT32_MAX;
+                break;
+            }
+            visiting[index] = true;
+            pending.push_back(index);
         }
+        while (pending.empty() == false) {
+            uint32_t index = pending.back();
+            pending.pop_back();
+            auto& chunk = scene[index];
+            miMaxNode* parent = root.get();
+            if (parents[index] != UINT32_MAX && nodes[parents[index]]) {
+                parent = nodes[parents[index]];
+            }
 
-        // Link
-        for (uint32_t i = 0; i < 4; ++i) {
-            Chunk const* linkChunk = getLinkChunk(scene, chunk, i);
-            if (linkChunk == nullptr)
-                continue;
-            switch (i) {
-            case 0: getPositionRotationScale(log, scene, *linkChunk, node); break;
-            case 1: getPrimitive(log, scene, *linkChunk, node);             break;
+            miMaxNode node;
+            node.index = index;
+
+            // Name
+            std::vector<uint16_t> propertyName = getProperty<uint16_t>(chunk, 0x0962);
+            if (propertyName.empty() == false) {
+                node.name = UTF16ToUTF8(propertyName.data(), propertyName.size());
+            }
+            else {
+                node.name = getClassName(context, chunk);
             }
-        }
 
-        // Text
-        std::vector<uint16_t> propertyText = getProperty<uint16_t>(chunk, 0x0120);
-        if (propertyText.empty() == false) {
-            node.text = UTF16ToUTF8(propertyText.data(), propertyText.size());
-        }
+            // Link
+            uint32_t meshIndex = UINT32_MAX;
+            for (uint32_t i = 0; i < 4; ++i) {
+                Chunk const* linkChunk = getLinkChunk(scene, chunk, i);
+                if (linkChunk == nullptr)
+                    continue;
+                switch (i) {
+                case 0: getPositionRotationScale(context, *linkChunk, node);   break;
+                case 1: meshIndex = uint32_t(linkChunk - scene.data());          break;
+                case 3: getMaterial(context, *linkChunk, node);                    break;
+                }
+            }
+
+            // Text
+            std::vector<uint16_t> propertyText = getProperty<uint16_t>(chunk, 0x0120);
+            if (propertyText.empty() == false) {
+                node.text = UTF16ToUTF8(propertyText.data(), propertyText.size());
+            }
 
-        // Attach
-        parent->emplace_back(std::move(node));
-        nodes[i] = &parent->back();
+            // Attach
+            parent->emplace_back(std::move(node));
+            nodes[index] = &parent->back();
+            if (meshIndex != UINT32_MAX) {
+                if (queued[meshIndex] == false) {
+                    queued[meshIndex] = true;
+                    meshIndices.push_back(meshIndex);
+                }
+                nodeMeshes.emplace_back(nodes[index], meshIndex);
+            }
+        }
     }
 
-    CATCH (std::exception const& e) {
-#if _CPPUNWIND || __cpp_exceptions
-        log("Exception : %s", e.what());
-        log("\n");
-#endif
-        if (file) {
-            fclose(file);
+    PROFILE_STOP(timerNode);
+
+    // Third Pass
+    PROFILE_TIMER(timerGeometry, "Geometry Pass");
+    // Caches are filled up front, so the decoders only read shared state
+    context.meshes.resize(scene.size());
+    std::vector<LogBuffer> meshLogs(meshIndices.size());
+    if (reader.geometry) {
+        PROFILE_TIMER(timerMesh, "Meshes");
+        parallelForEach(meshIndices.size(), [&](size_t i) {
+            logBuffer = &meshLogs[i];
+            getMesh(context, scene[meshIndices[i]]);
+            logBuffer = nullptr;
+        });
+    }
+    for (auto const& meshLog : meshLogs) {
+        std::string const& text = meshLog.text;
+        for (size_t begin = 0, end = 0; begin < text.size(); begin = end + 1) {
+            end = text.find('\n', begin);
+            log("%s", text.substr(begin, end - begin).c_str());
+        }
+    }
+    for (auto [node, meshIndex] : nodeMeshes) {
+        node->mesh = context.meshes[meshIndex];
+        if (node->mesh && node->text.empty()) {
+            node->text = node->mesh->text;
         }
-        delete root;
-        return nullptr;
     }
+    getWorldBounds(*root, { 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0 });
+
+    output = std::move(root);
+    return reader.error = MIMAX_OK;
+}
+
+miMaxError miMAXOpenFile(miMaxReader& reader, char const* name, std::unique_ptr<miMaxNode>& output)
+{
+    // Parse-time scratch lives in an arena that is released when the open returns
+    miMaxCountingResource counter;
+    ScratchResource scratch(&counter);
+    TaskEnter taskEnter = { logBuffer, &scratch };
+    miMaxError error = openFile(reader, name, output, &scratch);
+    reader.stats.scratchAllocations = counter.allocations;
+    reader.stats.scratchBytes = counter.peak;
+    return error;
+}
 
-    return root;
+miMaxNode* miMAXOpenFile(char const* name, int(*log)(char const*, ...))
+{
+    miMaxReader reader;
+    reader.log = log;
+    std::unique_ptr<miMaxNode> root;
+    miMAXOpenFile(reader, name, root);
+    return root.release();
 }
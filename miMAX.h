@@ -4,11 +4,222 @@
 */
 #pragma once
 
+#include <float.h>
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <functional>
 #include <list>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <string>
 #include <vector>
 
+struct miMaxBounds
+{
+public:
+    typedef std::array<float, 3> Point3;
+
+public:
+    Point3 minimum = { FLT_MAX, FLT_MAX, FLT_MAX };
+    Point3 maximum = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+    bool empty() const
+    {
+        return minimum[0] > maximum[0] || minimum[1] > maximum[1] || minimum[2] > maximum[2];
+    }
+
+    void merge(Point3 const& point)
+    {
+        for (int i = 0; i < 3; ++i) {
+            minimum[i] = std::min(minimum[i], point[i]);
+            maximum[i] = std::max(maximum[i], point[i]);
+        }
+    }
+
+    void merge(miMaxBounds const& bounds)
+    {
+        for (int i = 0; i < 3; ++i) {
+            minimum[i] = std::min(minimum[i], bounds.minimum[i]);
+            maximum[i] = std::max(maximum[i], bounds.maximum[i]);
+        }
+    }
+};
+
+struct miMaxSkin
+{
+public:
+    // Bind pose is the world transform of the bone at frame 0, composed through its parents
+    struct Bone
+    {
+        uint32_t node;                  // miMaxNode::index
+        uint32_t reference;             // Reference of the Skin modifier
+        std::array<float, 12> world;    // Axes and translation
+    };
+    std::vector<Bone> bone;
+
+    // weightBone indexes bone
+    std::vector<uint32_t> weightOffset;
+    std::vector<uint16_t> weightBone;
+    std::vector<float> weightValue;
+};
+
+struct miMaxSpline
+{
+public:
+    typedef std::array<float, 3> Point3;
+
+public:
+    // Bezier knots, tangents are absolute handle positions
+    std::pmr::vector<Point3> knot;
+    std::pmr::vector<Point3> inTangent;
+    std::pmr::vector<Point3> outTangent;
+
+    // Knots of spline i are [knotOffset[i], knotOffset[i + 1])
+    std::pmr::vector<uint32_t> knotOffset;
+    std::pmr::vector<uint8_t> closed;
+
+    // Adaptive polylines, points of spline i are [pointOffset[i], pointOffset[i + 1])
+    // A closed spline repeats its first point at the end
+    std::pmr::vector<Point3> point;
+    std::pmr::vector<uint32_t> pointOffset;
+
+    // Handle deviation over chord length of a sampled segment
+    static constexpr float defaultFlatness = 0.01f;
+
+    explicit miMaxSpline(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : knot(resource)
+        , inTangent(resource)
+        , outTangent(resource)
+        , knotOffset(1, 0, resource)
+        , closed(resource)
+        , point(resource)
+        , pointOffset(1, 0, resource)
+    {
+    }
+};
+
+struct miMaxMesh
+{
+public:
+    typedef std::array<float, 3> Point3;
+
+    struct Channel
+    {
+        std::pmr::vector<float> u;
+        std::pmr::vector<float> v;
+        std::pmr::vector<float> w;
+        std::pmr::vector<uint32_t> index;
+
+        explicit Channel(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+            : u(resource), v(resource), w(resource), index(resource) {}
+    };
+
+    struct MaterialRange
+    {
+        uint16_t materialID;
+        uint32_t faceBegin;
+        uint32_t faceCount;
+    };
+
+    struct Compact
+    {
+        typedef std::array<uint16_t, 2> Half2;
+        typedef std::array<uint8_t, 4> Color;
+
+        struct Channel
+        {
+            std::pmr::vector<Half2> uv;
+            std::pmr::vector<Color> color;
+            std::pmr::vector<uint32_t> index;
+
+            explicit Channel(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+                : uv(resource), color(resource), index(resource) {}
+        };
+
+        // vertex = offset + quantized * scale
+        Point3 offset = { 0, 0, 0 };
+        Point3 scale = { 0, 0, 0 };
+        std::pmr::vector<std::array<uint16_t, 3>> vertex;
+
+        // Octahedral, signed normalized
+        std::pmr::vector<std::array<int16_t, 2>> normal;
+
+        // -2 : Vertex Alpha, -1 : Vertex Illum, 0 : Vertex Color, 1-99 : Texture
+        // Vertex Alpha is folded into the alpha of Vertex Color when both share an index
+        std::map<int, Channel> channels;
+
+        Point3 getVertex(size_t index) const;
+        Point3 getNormal(size_t index) const;
+
+        explicit Compact(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+            : vertex(resource), normal(resource) {}
+    };
+
+    // Raw channel data copied out of the scene, so it outlives the file
+    struct ChannelSource
+    {
+        bool polygon = false;
+        std::pmr::vector<char> vertex;
+        std::pmr::vector<char> face;
+
+        explicit ChannelSource(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+            : vertex(resource), face(resource) {}
+    };
+
+public:
+    std::string text;
+
+    std::pmr::vector<Point3> vertex;
+    std::pmr::vector<Point3> normal;
+    std::pmr::vector<uint32_t> normalIndex;
+
+    std::pmr::vector<uint32_t> vertexArray;
+    std::pmr::vector<uint32_t> faceOffset;
+    std::pmr::vector<uint32_t> smoothingGroup;
+    std::pmr::vector<uint16_t> materialID;
+    std::pmr::vector<MaterialRange> materialRange;
+
+    miMaxSkin skin;
+
+    // Shape objects, faces are empty unless a modifier turns the shape into a mesh
+    miMaxSpline spline;
+
+    // Object space
+    miMaxBounds bounds;
+
+    // Filled instead of vertex, normal and channels when miMaxReader::compact is set
+    Compact compact;
+
+    // -2 : Vertex Alpha, -1 : Vertex Illum, 0 : Vertex Color, 1-99 : Texture
+    // Channel index is empty when the channel is indexed by vertex
+    Channel const* getChannel(int channel) const;
+
+    // Internal state of getChannel. A channel is either still in channelSources or already
+    // decoded in channels, guarded by channelMutex. faceOrder maps sorted faces to file order
+    // and is kept only while sources remain. Read these only to count channels.
+    std::map<int, ChannelSource> channelSources;
+    std::vector<uint32_t> faceOrder;
+    mutable std::map<int, Channel> channels;
+    mutable std::mutex channelMutex;
+
+    explicit miMaxMesh(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : vertex(resource)
+        , normal(resource)
+        , normalIndex(resource)
+        , vertexArray(resource)
+        , faceOffset(1, 0, resource)
+        , smoothingGroup(resource)
+        , materialID(resource)
+        , materialRange(resource)
+        , spline(resource)
+        , compact(resource)
+    {
+    }
+};
+
 struct miMaxNode : public std::list<miMaxNode>
 {
 public:
@@ -19,20 +230,25 @@ public:
     std::string name;
     std::string text;
 
+    uint32_t index = UINT32_MAX;
+
     Point3 position = { 0, 0, 0 };
     Point4 rotation = { 0, 0, 0, 1 };
     Point3 scale = { 1, 1, 1 };
 
-    std::vector<Point3> vertex;
-    std::vector<Point3> texture;
+    std::shared_ptr<miMaxMesh const> mesh;
 
-    std::vector<Point3> normal;
-    std::vector<Point3> vertexColor;
-    std::vector<Point3> vertexIllum;
-    std::vector<Point3> vertexAlpha;
+    // World space, for the mesh of this node and for the whole subtree
+    miMaxBounds bounds;
+    miMaxBounds hierarchyBounds;
 
-    std::vector<std::vector<uint32_t>> vertexArray;
-    std::vector<std::vector<uint32_t>> textureArray;
+    // Indexed by material ID, index is UINT32_MAX for IDs without a sub-material
+    struct Material
+    {
+        std::string name;
+        uint32_t index = UINT32_MAX;
+    };
+    std::vector<Material> material;
 
     int padding = 0;
 
@@ -48,17 +264,48 @@ public:
     };
 
 public:
-    struct Chunk : public std::vector<Chunk>
+    struct Class
+    {
+        std::string name;
+        ClassData classData = {};
+    };
+
+    struct Dll
+    {
+        std::string file;
+        std::string name;
+    };
+
+public:
+    struct Chunk : public std::pmr::vector<Chunk>
     {
-        std::vector<char> property;
+        std::pmr::vector<char> property;
 
+        uint64_t hash = 0;
+        uint64_t offset = 0;
+        uint64_t length = 0;
         uint16_t type = 0;
+        uint16_t classIndex = UINT16_MAX;
         uint16_t padding = 0;
-        ClassData classData = {};
-        std::string classDllFile;
-        std::string classDllName;
-        std::string name;
+
+        Chunk() = default;
+        Chunk(Chunk const&) = default;
+        Chunk(Chunk&&) = default;
+        Chunk& operator=(Chunk const&) = default;
+        Chunk& operator=(Chunk&&) = default;
+
+        // Children and properties follow the allocator of their parent
+        explicit Chunk(allocator_type const& allocator)
+            : std::pmr::vector<Chunk>(allocator), property(allocator) {}
+        Chunk(Chunk const& other, allocator_type const& allocator)
+            : std::pmr::vector<Chunk>(other, allocator), property(other.property, allocator)
+            , hash(other.hash), offset(other.offset), length(other.length), type(other.type), classIndex(other.classIndex), padding(other.padding) {}
+        Chunk(Chunk&& other, allocator_type const& allocator)
+            : std::pmr::vector<Chunk>(std::move(other), allocator), property(std::move(other.property), allocator)
+            , hash(other.hash), offset(other.offset), length(other.length), type(other.type), classIndex(other.classIndex), padding(other.padding) {}
     };
+    std::vector<Class> classes;
+    std::vector<Dll> dlls;
     Chunk* classData = nullptr;
     Chunk* classDirectory = nullptr;
     Chunk* config = nullptr;
@@ -77,7 +324,180 @@ public:
     }
 };
 
+struct miMaxBVH
+{
+public:
+    typedef std::array<float, 3> Point3;
+
+public:
+    struct Node
+    {
+        miMaxBounds bounds;
+        uint32_t index = 0;     // First child, or first item of a leaf
+        uint32_t count = 0;     // Item count of a leaf, 0 for an interior node
+    };
+    std::vector<Node> nodes;
+
+    struct Item
+    {
+        miMaxNode const* node;
+        std::array<float, 12> world;    // Axes and translation
+    };
+    std::vector<Item> items;
+
+    struct Hit
+    {
+        miMaxNode const* node = nullptr;
+        float distance = FLT_MAX;
+        uint32_t face = UINT32_MAX;     // UINT32_MAX when only the bounds are hit
+    };
+
+    bool raycast(Point3 const& origin, Point3 const& direction, Hit& hit) const;
+    void query(miMaxBounds const& bounds, std::vector<miMaxNode const*>& output) const;
+};
+
+struct miMaxDiff
+{
+    enum Type
+    {
+        ADDED,
+        REMOVED,
+        MODIFIED,
+    };
+    Type type = MODIFIED;
+    uint16_t chunkType = 0;
+    std::string path;
+    std::string name;
+
+    miMaxNode::Chunk const* left = nullptr;
+    miMaxNode::Chunk const* right = nullptr;
+};
+
+enum miMaxError
+{
+    MIMAX_OK,
+    MIMAX_FILE_NOT_FOUND,
+    MIMAX_FILE_NOT_READABLE,
+    MIMAX_FILE_NOT_COMPOUND,
+    MIMAX_SCENE_EMPTY,
+    MIMAX_SCENE_NOT_SUPPORTED,
+};
+
+struct miMaxCountingResource : public std::pmr::memory_resource
+{
+public:
+    std::pmr::memory_resource* upstream;
+
+    std::atomic<uint64_t> allocations = {};
+    std::atomic<uint64_t> deallocations = {};
+    std::atomic<uint64_t> bytes = {};       // Currently allocated
+    std::atomic<uint64_t> peak = {};
+    std::atomic<uint64_t> total = {};
+
+    explicit miMaxCountingResource(std::pmr::memory_resource* upstream = std::pmr::get_default_resource()) : upstream(upstream) {}
+
+protected:
+    void* do_allocate(size_t size, size_t alignment) override;
+    void do_deallocate(void* pointer, size_t size, size_t alignment) override;
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override;
+};
+
+struct miMaxStats
+{
+    struct Timer
+    {
+        char const* name;
+        uint64_t begin;     // microseconds since the open started
+        uint64_t duration;  // microseconds
+        uint32_t thread;    // 0 : the opening thread
+    };
+    std::vector<Timer> timers;
+
+    uint64_t chunks = 0;
+    uint64_t links = 0;
+    uint64_t propertyBytes = 0;
+    uint64_t unknownClasses = 0;
+
+    // Upstream of the per-thread scratch arenas
+    uint64_t scratchAllocations = 0;
+    uint64_t scratchBytes = 0;
+};
+
+struct miMaxProbe
+{
+    struct Stream
+    {
+        std::string name;
+        uint64_t size = 0;
+        bool compressed = false;    // gzip
+    };
+    std::vector<Stream> streams;
+    bool directoryTruncated = false;    // Only the first 4096 directory entries are listed
+
+    uint64_t fileSize = 0;
+    uint64_t bytesRead = 0;
+
+    // Root chunk of Scene, a compressed Scene is only walked on Apple platforms
+    uint16_t sceneType = 0;
+    char const* version = "";
+    bool sceneCompressed = false;
+    bool sceneProbed = false;           // False when the Scene was not walked, the fields below are unknown
+
+    // Top-level chunks of Scene, extrapolated from the first ones when sceneExact is false
+    uint64_t sceneChunks = 0;
+    bool sceneExact = false;
+
+    miMaxError error = MIMAX_OK;
+};
+
+// FAT chains of a compound file, sectors come from buffer (in memory or a mapped view) or from read (fread on demand)
+struct miMaxSectorChain
+{
+    char const* buffer = nullptr;
+    uint64_t fileSize = 0;
+    std::function<bool(uint64_t offset, void* data, size_t length)> read;
+
+    size_t sectorSize = 0;
+    uint32_t numFATSector = 0;
+    uint32_t difat = 0xFFFFFFFE;
+    std::vector<uint32_t> fatLocations;             // Header DIFAT, then the DIFAT chain as far as needed
+    std::vector<std::vector<uint32_t>> fatSectors;  // Loaded on demand
+
+    bool open(void const* header);                  // 512-byte compound file header, after the source is set
+    bool load(uint64_t offset, void* data, size_t length);
+    uint32_t next(uint32_t sector);                 // UINT32_MAX when the FAT does not cover sector
+    bool walk(uint32_t sector, uint64_t size, std::vector<uint64_t>& offsets);  // UINT64_MAX follows ENDOFCHAIN
+};
+
+struct miMaxReader
+{
+    // Options
+    bool parallel = true;
+    bool geometry = true;
+    bool compact = false;
+    int patchSteps = 5;             // Interior steps per patch edge of Editable Patch
+    float splineFlatness = miMaxSpline::defaultFlatness;
+    char const* trace = nullptr;    // Chrome trace-event JSON, needs MIMAX_PROFILE
+
+    // Chunks and meshes are allocated from this resource, which must outlive the tree
+    std::pmr::memory_resource* resource = nullptr;
+
+    // Diagnostics
+    int(*log)(char const*, ...) = nullptr;
+    std::vector<std::string> diagnostics;
+    miMaxStats stats;
+    miMaxError error = MIMAX_OK;
+};
+
+miMaxError miMAXOpenFile(miMaxReader& reader, char const* name, std::unique_ptr<miMaxNode>& root);
 miMaxNode* miMAXOpenFile(char const* name, int(*log)(char const*, ...));
+miMaxError miMAXProbeFile(char const* name, miMaxProbe& probe);
+void miMAXProbeFiles(std::vector<std::string> const& names, std::vector<miMaxProbe>& probes);
+void miMAXDiffFile(miMaxNode const& left, miMaxNode const& right, std::vector<miMaxDiff>& diff);
+bool miMAXExportGLB(miMaxNode const& root, char const* name, int(*log)(char const*, ...));
+void miMAXBuildBVH(miMaxNode const& root, miMaxBVH& bvh);
+void miMAXSweepSpline(miMaxSpline const& path, miMaxSpline const& profile, miMaxMesh& mesh);
+void miMAXPackSkin(miMaxSkin const& skin, std::vector<std::array<uint16_t, 4>>& bone, std::vector<std::array<uint8_t, 4>>& weight);
 
 #if defined(__MIMAX_INTERNAL__)
 typedef miMaxNode::ClassID ClassID;
@@ -91,6 +511,8 @@ typedef miMaxNode::Chunk Chunk;
 #define PARAMETER_BLOCK_SUPERCLASS_ID   0x00000008
 #define PARAMETER_BLOCK2_SUPERCLASS_ID  0x00000082
 #define GEOMOBJECT_SUPERCLASS_ID        0x00000010
+#define SHAPE_SUPERCLASS_ID             0x00000040
+#define MATERIAL_SUPERCLASS_ID          0x00000c00
 #define OSM_SUPERCLASS_ID               0x00000810
 #define FLOAT_SUPERCLASS_ID             0x00009003
 #define MATRIX3_SUPERCLASS_ID           0x00009008
@@ -98,6 +520,28 @@ typedef miMaxNode::Chunk Chunk;
 #define ROTATION_SUPERCLASS_ID          0x0000900c
 #define SCALE_SUPERCLASS_ID             0x0000900d
 
+#define TYPE_FLOAT                      0
+#define TYPE_INT                        1
+#define TYPE_RGBA                       2
+#define TYPE_POINT3                     3
+#define TYPE_BOOL                       4
+#define TYPE_ANGLE                      5
+#define TYPE_PCNT_FRAC                  6
+#define TYPE_WORLD                      7
+#define TYPE_STRING                     8
+#define TYPE_FILENAME                   9
+#define TYPE_MTL                        14
+#define TYPE_TEXMAP                     15
+#define TYPE_BITMAP                     16
+#define TYPE_INODE                      17
+#define TYPE_REFTARG                    18
+#define TYPE_INDEX                      19
+#define TYPE_MATRIX3                    20
+#define TYPE_PBLOCK2                    21
+#define TYPE_POINT4                     22
+#define TYPE_FRGBA                      23
+#define TYPE_TAB                        0x0800
+
 #define LININTERP_POSITION_CLASS_ID     ClassID{0x00002002, 0x00000000}
 #define LININTERP_ROTATION_CLASS_ID     ClassID{0x00002003, 0x00000000}
 #define LININTERP_SCALE_CLASS_ID        ClassID{0x00002004, 0x00000000}
@@ -122,7 +566,20 @@ typedef miMaxNode::Chunk Chunk;
 #define PLANE_CLASS_ID                  ClassID{0x081f1dfc, 0x77566f65}
 #define EDITTRIOBJ_CLASS_ID             ClassID{0xe44f10b3, 0x00000000}
 #define EPOLYOBJ_CLASS_ID               ClassID{0x1bf8338d, 0x192f6098}
+#define PATCHOBJ_CLASS_ID               ClassID{0x00001030, 0x00000000}
+#define SPLINESHAPE_CLASS_ID            ClassID{0x0000000a, 0x00000000}
+#define SPLINE3D_CLASS_ID               ClassID{0x00000010, 0x00000000}
+#define CIRCLE_CLASS_ID                 ClassID{0x00000025, 0x00000000}
+#define RECTANGLE_CLASS_ID              ClassID{0x00000029, 0x00000000}
+
+#define MULTI_CLASS_ID                  ClassID{0x00000200, 0x00000000}
 
+#define CLUSTOSM_CLASS_ID               ClassID{0x25215824, 0x00000000}
+#define UVWMAPOSM_CLASS_ID              ClassID{0x000f72b1, 0x00000000}
+#define SMOOTHOSM_CLASS_ID              ClassID{0x000f8613, 0x00000000}
+#define SKIN_CLASS_ID                   ClassID{0x0095c723, 0x00015666}
 #define EDIT_NORMALS_CLASS_ID           ClassID{0x4aa52ae3, 0x35ca1cde}
 #define PAINTLAYERMOD_CLASS_ID          ClassID{0x7ebb4645, 0x7be2044b}
+#define MIRROROSM_CLASS_ID              ClassID{0x00000100, 0x00000000}
+#define EXTRUDEOSM_CLASS_ID             ClassID{0x000000a0, 0x00000000}
 #endif
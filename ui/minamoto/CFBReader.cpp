@@ -9,10 +9,20 @@
 #include <ImGuiFileDialog/ImGuiFileDialog.h>
 #include <IconFontCppHeaders/IconsFontAwesome4.h>
 #include "CFBReader.h"
+#include "miMAX.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #if _CPPUNWIND == 0 && __cpp_exceptions == 0
 #include <setjmp.h>
-extern thread_local jmp_buf compoundfilereader_jmp_buf;
+static thread_local jmp_buf compoundfilereader_jmp_buf = {};
 #define try         if (setjmp(compoundfilereader_jmp_buf) == 0) {
 #define catch(x)    } else
 #define throw       longjmp(compoundfilereader_jmp_buf, 1);
@@ -34,7 +44,6 @@ static std::string format(char const* format, Args&&... args)
 static std::string path;
 static std::string info;
 static ImGuiFileDialog* fileDialog;
-static std::vector<char> fileContent;
 static size_t fileContentIndex;
 //------------------------------------------------------------------------------
 struct Node : public std::vector<std::tuple<size_t, std::string, size_t, Node>> {};
@@ -99,19 +108,141 @@ static void Finder(Node& node, std::function<void(size_t size, std::string const
     }
 }
 //------------------------------------------------------------------------------
-static std::pair<CFB::CompoundFileReader, std::vector<char>>* getCFB(std::string const& name)
+struct Session
+{
+    char const* data = nullptr;
+    size_t size = 0;
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int file = -1;
+#endif
+    CFB::CompoundFileReader* reader = nullptr;
+
+    ~Session()
+    {
+        delete reader;
+#if defined(_WIN32)
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+#else
+        if (data)
+            munmap((void*)data, size);
+        if (file >= 0)
+            close(file);
+#endif
+    }
+};
+static Session* session;
+//------------------------------------------------------------------------------
+static Session* OpenSession(std::string const& name)
+{
+    Session* session = new Session;
+#if defined(_WIN32)
+    session->file = CreateFileA(name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER size = {};
+    if (session->file != INVALID_HANDLE_VALUE && GetFileSizeEx(session->file, &size) && size.QuadPart)
+    {
+        session->mapping = CreateFileMappingA(session->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (session->mapping)
+        {
+            session->data = (char const*)MapViewOfFile(session->mapping, FILE_MAP_READ, 0, 0, 0);
+            session->size = session->data ? size_t(size.QuadPart) : 0;
+        }
+    }
+#else
+    session->file = open(name.c_str(), O_RDONLY);
+    struct stat st = {};
+    if (session->file >= 0 && fstat(session->file, &st) == 0 && st.st_size)
+    {
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, session->file, 0);
+        if (data != MAP_FAILED)
+        {
+            session->data = (char const*)data;
+            session->size = st.st_size;
+        }
+    }
+#endif
+    if (session->data)
+    {
+        try { session->reader = new CFB::CompoundFileReader(session->data, session->size); } catch (...) {}
+    }
+    if (session->reader == nullptr)
+    {
+        delete session;
+        return nullptr;
+    }
+
+    return session;
+}
+//------------------------------------------------------------------------------
+struct StreamView
 {
-    xxFile* file = xxFile::Load(name.c_str());
-    if (file)
+    CFB::COMPOUND_FILE_ENTRY const* entry = nullptr;
+    size_t size = 0;
+    size_t sectorSize = 0;
+    std::vector<size_t> sectors;
+
+    size_t read(size_t offset, void* buffer, size_t length) const
     {
-        std::vector<char> buffer(file->Size());
-        file->Read(buffer.data(), buffer.size());
-        delete file;
+        if (session == nullptr || entry == nullptr || offset >= size)
+            return 0;
+        length = std::min<size_t>(length, size - offset);
+
+        // Mini streams are below the cutoff size
+        if (sectors.empty())
+        {
+            try { session->reader->ReadFile(entry, offset, (char*)buffer, length); } catch (...) { return 0; }
+            return length;
+        }
 
-        try { return new std::pair{ CFB::CompoundFileReader(buffer.data(), buffer.size()), std::move(buffer) }; } catch (...) {}
+        size_t done = 0;
+        while (done < length)
+        {
+            size_t index = (offset + done) / sectorSize;
+            size_t inner = (offset + done) % sectorSize;
+            size_t count = std::min<size_t>(sectorSize - inner, length - done);
+            if (index >= sectors.size() || sectors[index] + inner + count > session->size)
+                break;
+            memcpy((char*)buffer + done, session->data + sectors[index] + inner, count);
+            done += count;
+        }
+        return done;
     }
+};
+static StreamView stream;
+//------------------------------------------------------------------------------
+static StreamView OpenStream(size_t entryID)
+{
+    StreamView view;
+    if (session == nullptr)
+        return view;
+    auto* reader = session->reader;
+    auto* header = reader->GetFileInfo();
+    auto* entry = reader->GetEntry(entryID);
+    if (header == nullptr || entry == nullptr)
+        return view;
+    view.entry = entry;
+    view.size = entry->size;
+    if (entry->size < header->miniStreamCutoffSize || header->sectorShift < 7 || header->sectorShift > 16)
+        return view;
 
-    return nullptr;
+    // Sector map, the mapped view is the sector source
+    miMaxSectorChain chain;
+    chain.buffer = session->data;
+    chain.fileSize = session->size;
+    std::vector<uint64_t> offsets;
+    if (chain.open(header) == false || chain.walk(entry->startSectorLocation, view.size, offsets) == false)
+        return view;
+    view.sectors.assign(offsets.begin(), offsets.end());
+    view.sectorSize = chain.sectorSize;
+
+    return view;
 }
 //------------------------------------------------------------------------------
 void CFBReader::Initialize()
@@ -128,6 +259,9 @@ void CFBReader::Shutdown()
 {
     delete fileDialog;
     root.clear();
+    stream = StreamView();
+    delete session;
+    session = nullptr;
 }
 //------------------------------------------------------------------------------
 bool CFBReader::Update(const UpdateData& updateData, bool& show)
@@ -156,33 +290,24 @@ bool CFBReader::Update(const UpdateData& updateData, bool& show)
         ImGui::Columns(2);
         Finder(root, [](size_t entryID, std::string const& name, size_t size)
         {
-            std::pair<CFB::CompoundFileReader, std::vector<char>>* cfb = getCFB(fileDialog->GetFilePathName());
-            if (cfb)
-            {
-                auto& reader = cfb->first;
-                auto* entry = reader.GetEntry(entryID);
-                if (entry)
-                {
-                    fileContent.resize(size);
-                    try { reader.ReadFile(entry, 0, fileContent.data(), fileContent.size()); } catch (...) {}
-                }
-                delete cfb;
-            }
+            stream = OpenStream(entryID);
             fileContentIndex = 0;
         });
         ImGui::NextColumn();
-        for (size_t i = fileContentIndex, size = fileContent.size(); i < fileContentIndex + 256; i += 16)
+        char fileContent[256];
+        size_t fileContentSize = stream.read(fileContentIndex, fileContent, 256);
+        for (size_t i = 0; i < 256; i += 16)
         {
             size_t count;
-            if (i >= size)
+            if (i >= fileContentSize)
                 count = 0;
-            else if ((i + 16) > size)
-                count = fileContent.size() % 16;
+            else if ((i + 16) > fileContentSize)
+                count = fileContentSize % 16;
             else
                 count = 16;
 
             uint8_t pitch[16] = {};
-            memcpy(pitch, fileContent.data() + i, count);
+            memcpy(pitch, fileContent + i, count);
 
             char line[64];
             for (size_t i = 0; i < 16; ++i)
@@ -207,11 +332,11 @@ bool CFBReader::Update(const UpdateData& updateData, bool& show)
             float wheel = ImGui::GetIO().MouseWheel;
             if (wheel > 0.0f && fileContentIndex - 16 < fileContentIndex)
                 fileContentIndex -= 16;
-            if (wheel < 0.0f && fileContentIndex + 16 < fileContent.size())
+            if (wheel < 0.0f && fileContentIndex + 16 < stream.size)
                 fileContentIndex += 16;
             if (ImGui::IsKeyReleased(ImGuiKey_PageUp) && fileContentIndex - 256 < fileContentIndex)
                 fileContentIndex -= 256;
-            if (ImGui::IsKeyReleased(ImGuiKey_PageDown) && fileContentIndex + 256 < fileContent.size())
+            if (ImGui::IsKeyReleased(ImGuiKey_PageDown) && fileContentIndex + 256 < stream.size)
                 fileContentIndex += 256;
         }
         ImGui::Columns(1);
@@ -227,10 +352,12 @@ bool CFBReader::Update(const UpdateData& updateData, bool& show)
             path = fileDialog->GetFilePathName();
             info.clear();
 
-            std::pair<CFB::CompoundFileReader, std::vector<char>>* cfb = getCFB(path);
-            if (cfb)
+            stream = StreamView();
+            delete session;
+            session = OpenSession(path);
+            if (session)
             {
-                auto& reader = cfb->first;
+                auto& reader = *session->reader;
                 const CFB::COMPOUND_FILE_HDR* hdr = reader.GetFileInfo();
 
                 info.clear();
@@ -267,8 +394,6 @@ bool CFBReader::Update(const UpdateData& updateData, bool& show)
                     mappedEntry[reader.GetEntry(entry->rightSiblingID)] = entry->rightSiblingID;
                     mappedEntry[reader.GetEntry(entry->childID)] = entry->childID;
                 });
-
-                delete cfb;
             }
         }
         fileDialog->Close();
@@ -5,6 +5,10 @@
 // https://github.com/metarutaiga/miMAX
 //==============================================================================
 #include "MaxReaderPCH.h"
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <thread>
 #include <xxGraphicPlus/xxFile.h>
 #include <ImGuiFileDialog/ImGuiFileDialog.h>
 #include <IconFontCppHeaders/IconsFontAwesome4.h>
@@ -38,11 +42,108 @@ static int MaxReaderLog(char const* format, ...)
     return result;
 }
 //------------------------------------------------------------------------------
-static bool ChunkFinder(miMaxNode::Chunk& chunk, std::function<void(uint16_t type, std::vector<char> const& property)> select)
+static miMaxNode::Class const* ChunkClass(miMaxNode::Chunk const& chunk)
 {
-    static void* selected;
+    if (root == nullptr || root->classes.size() <= chunk.classIndex)
+        return nullptr;
+    return &root->classes[chunk.classIndex];
+}
+//------------------------------------------------------------------------------
+struct ChunkRow
+{
+    miMaxNode::Chunk* chunk;
+    size_t index;
+    int depth;
+};
+//------------------------------------------------------------------------------
+struct ChunkSize
+{
+    size_t size;
+    size_t count;
+};
+//------------------------------------------------------------------------------
+static std::map<miMaxNode::Chunk const*, ChunkSize> chunkSizes;
+static std::vector<ChunkRow> chunkRows;
+static miMaxNode::Chunk const* chunkRowsRoot;
+static bool chunkRowsDirty;
+static void* chunkSelected;
+static bool chunkScroll;
+static int chunkTab;
+static int chunkTabSelect = -1;
+static std::vector<char> fileContent;
+static size_t fileContentIndex;
+static size_t fileContentVersion;
+static uint16_t fileContentType;
+//------------------------------------------------------------------------------
+static ChunkSize ChunkMeasure(miMaxNode::Chunk const& chunk)
+{
+    ChunkSize size = { chunk.property.size(), 0 };
+    for (auto const& child : chunk)
+    {
+        ChunkSize childSize = ChunkMeasure(child);
+        size.size += childSize.size;
+        size.count += childSize.count + 1;
+    }
+    if (chunk.empty() == false)
+    {
+        chunkSizes[&chunk] = size;
+    }
+    return size;
+}
+//------------------------------------------------------------------------------
+static void ChunkReset()
+{
+    chunkSizes.clear();
+    chunkRows.clear();
+    chunkRowsRoot = nullptr;
+    if (root)
+    {
+        for (auto* chunk : { root->classData, root->classDirectory, root->config, root->dllDirectory, root->scene, root->videoPostQueue })
+        {
+            if (chunk)
+            {
+                ChunkMeasure(*chunk);
+            }
+        }
+    }
+}
+//------------------------------------------------------------------------------
+static void ChunkFlatten(miMaxNode::Chunk& chunk, int depth)
+{
+    for (size_t i = 0; i < chunk.size(); ++i)
+    {
+        auto& child = chunk[i];
+        chunkRows.push_back({ &child, i, depth });
+        if (child.empty() == false && (child.padding & 1))
+        {
+            ChunkFlatten(child, depth + 1);
+        }
+    }
+}
+//------------------------------------------------------------------------------
+static bool ChunkFinder(miMaxNode::Chunk& chunk, std::function<void(uint16_t type, std::pmr::vector<char> const& property)> select)
+{
+    auto& selected = chunkSelected;
     bool updated = false;
 
+    // Visible rows
+    if (chunkRowsRoot != &chunk || chunkRowsDirty)
+    {
+        chunkRows.clear();
+        ChunkFlatten(chunk, 0);
+        chunkRowsRoot = &chunk;
+        chunkRowsDirty = false;
+    }
+    if (chunkScroll)
+    {
+        auto it = std::find_if(chunkRows.begin(), chunkRows.end(), [](ChunkRow const& row) { return row.chunk == chunkSelected; });
+        if (it != chunkRows.end())
+        {
+            ImGui::SetScrollY(std::distance(chunkRows.begin(), it) * ImGui::GetTextLineHeightWithSpacing());
+        }
+        chunkScroll = false;
+    }
+
     // Chunk
     if (selected)
     {
@@ -51,104 +152,458 @@ static bool ChunkFinder(miMaxNode::Chunk& chunk, std::function<void(uint16_t typ
         if (ImGui::IsKeyPressed(ImGuiKey_DownArrow)) delta = 1;
         if (delta != 0)
         {
-            size_t index = std::distance(chunk.data(), (miMaxNode::Chunk::value_type*)selected) + delta;
-            if (index < chunk.size())
+            auto it = std::find_if(chunkRows.begin(), chunkRows.end(), [](ChunkRow const& row) { return row.chunk == chunkSelected; });
+            size_t index = std::distance(chunkRows.begin(), it) + delta;
+            if (it != chunkRows.end() && index < chunkRows.size())
             {
-                auto& child = chunk[index];
+                auto& child = *chunkRows[index].chunk;
                 select(child.type, child.property);
                 selected = &child;
                 updated = true;
             }
         }
     }
-    for (size_t i = 0; i < chunk.size(); ++i)
+
+    ImGuiListClipper clipper;
+    clipper.Begin(int(chunkRows.size()));
+    while (clipper.Step())
     {
-        auto& child = chunk[i];
-        auto& flags = child.padding;
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+        {
+            auto [pointer, i, depth] = chunkRows[row];
+            auto& child = *pointer;
+            auto& flags = child.padding;
+            auto* childClass = ChunkClass(child);
 
-        char text[128];
-        if (child.empty())
+            char name[8];
+            snprintf(name, 8, "%04X", child.type);
+
+            char text[128];
+            if (child.empty())
+            {
+                snprintf(text, 128, "%s%zX:%s", ICON_FA_FILE_TEXT, i, childClass ? childClass->name.c_str() : name);
+            }
+            else
+            {
+                snprintf(text, 128, "%s%zX:%s", (flags & 1) ? ICON_FA_CIRCLE_O : ICON_FA_CIRCLE, i, childClass ? childClass->name.c_str() : name);
+            }
+
+            ChunkSize size = { child.property.size(), 0 };
+            if (child.empty() == false)
+            {
+                auto it = chunkSizes.find(&child);
+                if (it != chunkSizes.end())
+                    size = (*it).second;
+            }
+
+            ImGui::SetCursorPosX(ImGui::GetCursorPosX() + depth * ImGui::GetStyle().IndentSpacing);
+            ImGui::PushID(&child);
+            ImGui::Selectable(text, selected == &child);
+            ImGui::PopID();
+            if (ImGui::IsItemHovered())
+            {
+                ImGui::BeginTooltip();
+                if (childClass)
+                {
+                    auto& classData = childClass->classData;
+                    char const* dllFile = "(Internal)";
+                    char const* dllName = "(Internal)";
+                    if (classData.dllIndex != UINT32_MAX)
+                    {
+                        dllFile = "(Unknown)";
+                        dllName = "(Unknown)";
+                        if (classData.dllIndex < root->dlls.size())
+                        {
+                            dllFile = root->dlls[classData.dllIndex].file.c_str();
+                            dllName = root->dlls[classData.dllIndex].name.c_str();
+                        }
+                    }
+                    ImGui::Text("Index:%zX", i);
+                    ImGui::Text("Type:%04X", child.type);
+                    ImGui::Text("Class:%08X-%08X-%08X-%08X", classData.dllIndex, classData.classID.first, classData.classID.second, classData.superClassID);
+                    ImGui::Text("DllFile:%s", dllFile);
+                    ImGui::Text("DllName:%s", dllName);
+                    ImGui::Text("Name:%s", childClass->name.c_str());
+                }
+                ImGui::Text("Size:%zd", size.size);
+                if (child.empty() == false)
+                {
+                    ImGui::Text("Child:%zd", child.size());
+                    ImGui::Text("Descendant:%zd", size.count);
+                }
+                ImGui::EndTooltip();
+
+                if (ImGui::IsItemClicked() && selected != &child)
+                {
+                    select(child.type, child.property);
+                    selected = &child;
+                    updated = true;
+                }
+                if (child.empty() == false && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left))
+                {
+                    flags ^= 1;
+                    chunkRowsDirty = true;
+                }
+            }
+        }
+    }
+
+    return updated;
+}
+//------------------------------------------------------------------------------
+struct SearchEntry
+{
+    miMaxNode::Chunk* chunk;
+    uint32_t parent;
+    int tab;
+};
+//------------------------------------------------------------------------------
+static std::vector<SearchEntry> searchEntries;
+static std::map<uint16_t, std::vector<uint32_t>> searchTypes;
+static std::vector<std::vector<uint32_t>> searchClasses;
+static std::vector<uint32_t> searchResults;
+static std::mutex searchMutex;
+static std::thread searchThread;
+static std::atomic<bool> searchCancel;
+static std::atomic<bool> searchRunning;
+static std::atomic<size_t> searchProgress;
+//------------------------------------------------------------------------------
+static void SearchStop()
+{
+    searchCancel = true;
+    if (searchThread.joinable())
+    {
+        searchThread.join();
+    }
+    searchCancel = false;
+}
+//------------------------------------------------------------------------------
+static void SearchReset()
+{
+    SearchStop();
+    searchEntries.clear();
+    searchTypes.clear();
+    searchClasses.clear();
+    searchResults.clear();
+    searchProgress = 0;
+    if (root == nullptr)
+        return;
+
+    // Flatten every stream in pre-order, so a parent always comes before its children
+    std::function<void(miMaxNode::Chunk&, uint32_t, int)> flatten = [&](miMaxNode::Chunk& chunk, uint32_t parent, int tab)
+    {
+        for (auto& child : chunk)
         {
-            snprintf(text, 128, "%s%zX:%s", ICON_FA_FILE_TEXT, i, child.name.c_str());
+            uint32_t id = uint32_t(searchEntries.size());
+            searchEntries.push_back({ &child, parent, tab });
+            searchTypes[child.type].push_back(id);
+            if (child.classIndex < root->classes.size())
+            {
+                if (searchClasses.size() <= child.classIndex)
+                    searchClasses.resize(child.classIndex + 1);
+                searchClasses[child.classIndex].push_back(id);
+            }
+            flatten(child, id, tab);
         }
-        else
+    };
+    int tab = 0;
+    for (auto* chunk : { root->classData, root->classDirectory, root->config, root->dllDirectory, root->scene, root->videoPostQueue })
+    {
+        if (chunk)
         {
-            snprintf(text, 128, "%s%zX:%s", (flags & 1) ? ICON_FA_CIRCLE_O : ICON_FA_CIRCLE, i, child.name.c_str());
+            flatten(*chunk, UINT32_MAX, tab);
         }
+        tab++;
+    }
+}
+//------------------------------------------------------------------------------
+static bool SearchContains(std::string const& text, std::string const& query)
+{
+    auto it = std::search(text.begin(), text.end(), query.begin(), query.end(), [](char a, char b)
+    {
+        return tolower((uint8_t)a) == tolower((uint8_t)b);
+    });
+    return it != text.end();
+}
+//------------------------------------------------------------------------------
+static bool SearchBytes(std::pmr::vector<char> const& data, std::string const& pattern)
+{
+    if (pattern.empty() || data.size() < pattern.size())
+        return false;
 
-        ImGui::PushID(&child);
-        ImGui::Selectable(text, selected == &child);
-        ImGui::PopID();
-        if (ImGui::IsItemHovered())
+    // memchr and memcmp are vectorized by the C library
+    char const* begin = data.data();
+    char const* end = data.data() + data.size() - pattern.size() + 1;
+    while (begin < end)
+    {
+        begin = (char const*)memchr(begin, pattern[0], end - begin);
+        if (begin == nullptr)
+            break;
+        if (memcmp(begin, pattern.data(), pattern.size()) == 0)
+            return true;
+        begin++;
+    }
+    return false;
+}
+//------------------------------------------------------------------------------
+static void SearchStart(int mode, std::string const& query)
+{
+    SearchStop();
+    searchResults.clear();
+    searchProgress = 0;
+    if (root == nullptr || query.empty())
+        return;
+
+    searchRunning = true;
+    searchThread = std::thread([mode, query]()
+    {
+        std::vector<uint32_t> found;
+        auto flush = [&]()
         {
-            if (child.classDllName.empty() == false)
+            std::lock_guard<std::mutex> lock(searchMutex);
+            searchResults.insert(searchResults.end(), found.begin(), found.end());
+            found.clear();
+        };
+
+        switch (mode)
+        {
+        case 0:
+        {
+            // Type
+            uint16_t type = uint16_t(strtoul(query.c_str(), nullptr, 16));
+            auto it = searchTypes.find(type);
+            if (it != searchTypes.end())
+                found = (*it).second;
+            break;
+        }
+        case 1:
+        case 2:
+        {
+            // Class or DLL
+            for (size_t i = 0; i < searchClasses.size() && searchCancel == false; ++i)
             {
-                ImGui::BeginTooltip();
-                ImGui::Text("Index:%zX", i);
-                ImGui::Text("Type:%04X", child.type);
-                ImGui::Text("Class:%08X-%08X-%08X-%08X", child.classData.dllIndex, child.classData.classID.first, child.classData.classID.second, child.classData.superClassID);
-                ImGui::Text("DllFile:%s", child.classDllFile.c_str());
-                ImGui::Text("DllName:%s", child.classDllName.c_str());
-                ImGui::Text("Name:%s", child.name.c_str());
-                if (child.empty())
+                auto& classData = root->classes[i];
+                bool match = false;
+                if (mode == 1)
                 {
-                    ImGui::Text("Size:%zd", child.property.size());
+                    match = SearchContains(classData.name, query);
                 }
-                else
+                else if (classData.classData.dllIndex < root->dlls.size())
                 {
-                    size_t size = 0;
-                    std::function<void(miMaxNode::Chunk const&)> traversal = [&](miMaxNode::Chunk const& chunk)
-                    {
-                        size += chunk.property.size();
-                        for (auto const& child : chunk)
-                            traversal(child);
-                    };
-                    traversal(child);
-                    ImGui::Text("Size:%zd", size);
+                    auto& dll = root->dlls[classData.classData.dllIndex];
+                    match = SearchContains(dll.file, query) || SearchContains(dll.name, query);
+                }
+                if (match)
+                {
+                    found.insert(found.end(), searchClasses[i].begin(), searchClasses[i].end());
                 }
-                ImGui::EndTooltip();
             }
-            else
+            std::sort(found.begin(), found.end());
+            break;
+        }
+        case 3:
+        case 4:
+        {
+            // Text in UTF-8 and UTF-16, or hexadecimal bytes
+            std::vector<std::string> patterns;
+            if (mode == 3)
             {
-                ImGui::BeginTooltip();
-                if (child.empty())
+                std::string utf16;
+                for (char c : query)
                 {
-                    ImGui::Text("Size:%zd", child.property.size());
+                    utf16 += c;
+                    utf16 += '\0';
                 }
-                else
+                patterns = { query, utf16 };
+            }
+            else
+            {
+                std::string bytes;
+                for (size_t i = 0; i < query.size(); )
                 {
-                    size_t size = 0;
-                    std::function<void(miMaxNode::Chunk const&)> traversal = [&](miMaxNode::Chunk const& chunk)
+                    if (isxdigit((uint8_t)query[i]) == false)
                     {
-                        size += chunk.property.size();
-                        for (auto const& child : chunk)
-                            traversal(child);
-                    };
-                    traversal(child);
-                    ImGui::Text("Size:%zd", size);
+                        i++;
+                        continue;
+                    }
+                    char hex[3] = { query[i], i + 1 < query.size() ? query[i + 1] : '0', 0 };
+                    bytes += char(strtoul(hex, nullptr, 16));
+                    i += 2;
                 }
-                ImGui::EndTooltip();
+                patterns = { bytes };
             }
-            if (ImGui::IsItemClicked() && selected != &child)
+            for (size_t i = 0; i < searchEntries.size() && searchCancel == false; ++i)
             {
-                select(child.type, child.property);
-                selected = &child;
-                updated = true;
+                auto& property = searchEntries[i].chunk->property;
+                for (auto const& pattern : patterns)
+                {
+                    if (SearchBytes(property, pattern))
+                    {
+                        found.push_back(uint32_t(i));
+                        break;
+                    }
+                }
+                if ((i & 0xFFF) == 0)
+                {
+                    searchProgress = i;
+                    flush();
+                }
             }
-            if (child.empty() == false && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left))
+            break;
+        }
+        }
+        searchProgress = searchEntries.size();
+        flush();
+        searchRunning = false;
+    });
+}
+//------------------------------------------------------------------------------
+static void SearchSelect(uint32_t id)
+{
+    auto& entry = searchEntries[id];
+    for (uint32_t parent = entry.parent; parent != UINT32_MAX; parent = searchEntries[parent].parent)
+    {
+        searchEntries[parent].chunk->padding |= 1;
+    }
+    chunkRowsDirty = true;
+    chunkSelected = entry.chunk;
+    chunkScroll = true;
+    chunkTabSelect = entry.tab;
+    fileContent.assign(entry.chunk->property.begin(), entry.chunk->property.end());
+    fileContentIndex = 0;
+    fileContentType = entry.chunk->type;
+    fileContentVersion++;
+}
+//------------------------------------------------------------------------------
+static void SearchFinder()
+{
+    static int mode;
+    static std::string query;
+
+    ImGui::SetNextItemWidth(160.0f);
+    ImGui::Combo("##SearchMode", &mode, "Type\0Class\0DLL\0Text\0Hex\0");
+    ImGui::SameLine();
+    ImGui::InputTextEx("SEARCH", nullptr, query);
+    ImGui::SameLine();
+    if (ImGui::Button(ICON_FA_SEARCH))
+    {
+        SearchStart(mode, query);
+    }
+    ImGui::SameLine();
+    if (searchRunning)
+    {
+        ImGui::Text("%zd / %zd", size_t(searchProgress), searchEntries.size());
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(searchMutex);
+        ImGui::Text("%zd", searchResults.size());
+    }
+
+    std::lock_guard<std::mutex> lock(searchMutex);
+    if (searchResults.empty())
+        return;
+    if (ImGui::BeginChild("SearchResult", ImVec2(0, ImGui::GetTextLineHeightWithSpacing() * 6)))
+    {
+        static char const* const tabs[] = { "ClassData", "ClassDirectory", "Config", "DllDirectory", "Scene", "VideoPostQueue" };
+        ImGuiListClipper clipper;
+        clipper.Begin(int(searchResults.size()));
+        while (clipper.Step())
+        {
+            for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
             {
-                flags ^= 1;
+                uint32_t id = searchResults[row];
+                auto& entry = searchEntries[id];
+                auto* chunkClass = ChunkClass(*entry.chunk);
+
+                std::string path;
+                for (uint32_t index = id; index != UINT32_MAX; index = searchEntries[index].parent)
+                {
+                    uint32_t parent = searchEntries[index].parent;
+                    size_t offset = 0;
+                    if (parent != UINT32_MAX)
+                        offset = std::distance(searchEntries[parent].chunk->data(), searchEntries[index].chunk);
+                    else if (root)
+                    {
+                        miMaxNode::Chunk* streams[] = { root->classData, root->classDirectory, root->config, root->dllDirectory, root->scene, root->videoPostQueue };
+                        offset = std::distance(streams[entry.tab]->data(), searchEntries[index].chunk);
+                    }
+                    char text[16];
+                    snprintf(text, 16, "/%zX", offset);
+                    path.insert(0, text);
+                }
+
+                char text[256];
+                snprintf(text, 256, "%s%s %04X %s", tabs[entry.tab], path.c_str(), entry.chunk->type, chunkClass ? chunkClass->name.c_str() : "");
+                ImGui::PushID(row);
+                if (ImGui::Selectable(text, chunkSelected == entry.chunk))
+                {
+                    SearchSelect(id);
+                }
+                ImGui::PopID();
             }
         }
-        if (child.empty() == false && (flags & 1))
+        ImGui::EndChild();
+    }
+}
+//------------------------------------------------------------------------------
+static miMaxNode* diffRoot;
+static std::vector<miMaxDiff> diffs;
+//------------------------------------------------------------------------------
+static void DiffReset()
+{
+    diffs.clear();
+    delete diffRoot;
+    diffRoot = nullptr;
+}
+//------------------------------------------------------------------------------
+static void DiffFinder()
+{
+    if (diffs.empty())
+        return;
+    if (ImGui::BeginChild("DiffResult", ImVec2(0, ImGui::GetTextLineHeightWithSpacing() * 6)))
+    {
+        ImGuiListClipper clipper;
+        clipper.Begin(int(diffs.size()));
+        while (clipper.Step())
         {
-            ImGui::Indent();
-            updated |= ChunkFinder(child, select);
-            ImGui::Unindent();
+            for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+            {
+                auto& diff = diffs[row];
+                char const* type = "";
+                switch (diff.type)
+                {
+                case miMaxDiff::ADDED:      type = "+"; break;
+                case miMaxDiff::REMOVED:    type = "-"; break;
+                case miMaxDiff::MODIFIED:   type = "*"; break;
+                }
+
+                char left[64] = "";
+                char right[64] = "";
+                if (diff.left)
+                    snprintf(left, 64, "%llX+%llX", (unsigned long long)diff.left->offset, (unsigned long long)diff.left->length);
+                if (diff.right)
+                    snprintf(right, 64, "%llX+%llX", (unsigned long long)diff.right->offset, (unsigned long long)diff.right->length);
+
+                char text[256];
+                snprintf(text, 256, "%s %s %04X %s [%s] [%s]", type, diff.path.c_str(), diff.chunkType, diff.name.c_str(), left, right);
+                ImGui::PushID(row);
+                if (ImGui::Selectable(text, diff.left && chunkSelected == diff.left) && diff.left)
+                {
+                    for (size_t i = 0; i < searchEntries.size(); ++i)
+                    {
+                        if (searchEntries[i].chunk == diff.left)
+                        {
+                            SearchSelect(uint32_t(i));
+                            break;
+                        }
+                    }
+                }
+                ImGui::PopID();
+            }
         }
+        ImGui::EndChild();
     }
-
-    return updated;
 }
 //------------------------------------------------------------------------------
 static bool NodeFinder(miMaxNode& node, std::function<void(std::string& text)> select)
@@ -207,18 +662,35 @@ static bool NodeFinder(miMaxNode& node, std::function<void(std::string& text)> s
             ImGui::Text("Position:%g, %g, %g", child.position[0], child.position[1], child.position[2]);
             ImGui::Text("Rotation:%g, %g, %g, %g", child.rotation[0], child.rotation[1], child.rotation[2], child.rotation[3]);
             ImGui::Text("Scale:%g, %g, %g", child.scale[0], child.scale[1], child.scale[2]);
-            if (child.vertex.empty() == false)
+            if (child.hierarchyBounds.empty() == false)
             {
+                auto& bounds = child.hierarchyBounds;
+                ImGui::Text("Bounds:%g, %g, %g - %g, %g, %g", bounds.minimum[0], bounds.minimum[1], bounds.minimum[2], bounds.maximum[0], bounds.maximum[1], bounds.maximum[2]);
+            }
+            for (auto const& material : child.material)
+            {
+                if (material.index == UINT32_MAX)
+                    continue;
+                ImGui::Text("Material:%s", material.name.c_str());
+            }
+            if (child.mesh && child.mesh->vertex.empty() == false)
+            {
+                auto& mesh = *child.mesh;
                 ImGui::Separator();
-                ImGui::Text("Vertex : %zd", child.vertex.size());
-                ImGui::Text("Texture : %zd", child.texture.size());
-                ImGui::Text("Normal : %zd", child.normal.size());
-                ImGui::Text("Vertex Color : %zd", child.vertexColor.size());
-//              ImGui::Text("Vertex Illum : %zd", child.vertexIllum.size());
-                ImGui::Text("Vertex Alpha : %zd", child.vertexAlpha.size());
-                ImGui::Text("Vertex Array : %zd", child.vertexArray.size());
-                ImGui::Text("Texture Array : %zd", child.textureArray.size());
-//              ImGui::Text("Polygon Array : %zd", child.polygonArray.size());
+                ImGui::Text("Instance : %ld", child.mesh.use_count());
+                ImGui::Text("Vertex : %zd", mesh.vertex.size());
+                ImGui::Text("Normal : %zd", mesh.normal.size());
+                ImGui::Text("Vertex Array : %zd", mesh.faceOffset.size() - 1);
+                size_t channelCount = mesh.channelSources.size();
+                for (auto const& [index, channel] : mesh.channels)
+                {
+                    if (mesh.channelSources.count(index) == 0)
+                        channelCount++;
+                }
+                ImGui::Text("Map Channel : %zd", channelCount);
+                ImGui::Text("Material Range : %zd", mesh.materialRange.size());
+                ImGui::Text("Skin : %zd", mesh.skin.bone.size());
+//              ImGui::Text("Polygon Array : %zd", mesh.polygonArray.size());
             }
             ImGui::EndTooltip();
 
@@ -243,6 +715,306 @@ static bool NodeFinder(miMaxNode& node, std::function<void(std::string& text)> s
     return updated;
 }
 //------------------------------------------------------------------------------
+static void HexView()
+{
+    for (size_t i = fileContentIndex, size = fileContent.size(); i < fileContentIndex + 256; i += 16)
+    {
+        size_t count;
+        if (i >= size)
+            count = 0;
+        else if ((i + 16) > size)
+            count = fileContent.size() % 16;
+        else
+            count = 16;
+
+        uint8_t pitch[16] = {};
+        memcpy(pitch, fileContent.data() + i, count);
+
+        static char const hex[] = "0123456789abcdef";
+        char line[64];
+        for (size_t i = 0; i < 16; ++i)
+        {
+            line[i * 3 + 0] = i < count ? hex[pitch[i] >> 4] : ' ';
+            line[i * 3 + 1] = i < count ? hex[pitch[i] & 15] : ' ';
+            line[i * 3 + 2] = i + 1 < count && (i + 1) % 4 == 0 ? '-' : ' ';
+        }
+        line[47] = 0;
+        ImGui::TextUnformatted(line);
+        ImGui::SameLine();
+        for (uint8_t& c : pitch)
+        {
+            if (c == 0 || c == '\t' || c == '\n')
+                c = ' ';
+        }
+        ImGui::Text("\t%c%c%c%c%c%c%c%c%c%c%c%c%c%c%c%c",
+                    pitch[0], pitch[1], pitch[2], pitch[3],
+                    pitch[4], pitch[5], pitch[6], pitch[7],
+                    pitch[8], pitch[9], pitch[10], pitch[11],
+                    pitch[12], pitch[13], pitch[14], pitch[15]);
+    }
+    if (ImGui::IsWindowHovered())
+    {
+        float wheel = ImGui::GetIO().MouseWheel;
+        if (wheel > 0.0f && fileContentIndex - 16 < fileContentIndex)
+            fileContentIndex -= 16;
+        if (wheel < 0.0f && fileContentIndex + 16 < fileContent.size())
+            fileContentIndex += 16;
+        if (ImGui::IsKeyReleased(ImGuiKey_PageUp) && fileContentIndex - 256 < fileContentIndex)
+            fileContentIndex -= 256;
+        if (ImGui::IsKeyReleased(ImGuiKey_PageDown) && fileContentIndex + 256 < fileContent.size())
+            fileContentIndex += 256;
+    }
+}
+//------------------------------------------------------------------------------
+static size_t InspectorSize(int mode)
+{
+    switch (mode)
+    {
+    case 1: return sizeof(float);
+    case 2: return sizeof(int32_t);
+    case 3: return sizeof(uint16_t);
+    case 4: return sizeof(uint16_t);
+    }
+    return 1;
+}
+//------------------------------------------------------------------------------
+static double InspectorValue(int mode, char const* data)
+{
+    switch (mode)
+    {
+    case 1: { float value; memcpy(&value, data, sizeof(value)); return value; }
+    case 2: { int32_t value; memcpy(&value, data, sizeof(value)); return value; }
+    case 3: { uint16_t value; memcpy(&value, data, sizeof(value)); return value; }
+    }
+    return 0.0;
+}
+//------------------------------------------------------------------------------
+static void InspectorGuess(int mode, char const* data, size_t size, int& skip, int& stride)
+{
+    size_t elementSize = InspectorSize(mode);
+    skip = 0;
+    stride = 1;
+
+    // Arrays often start with an element count
+    if (size > sizeof(uint32_t))
+    {
+        uint32_t count;
+        memcpy(&count, data, sizeof(uint32_t));
+        size_t remain = (size - sizeof(uint32_t)) / elementSize;
+        if (count && remain % count == 0 && remain / count <= 16)
+        {
+            skip = sizeof(uint32_t);
+            stride = int(remain / count);
+            return;
+        }
+    }
+
+    // Otherwise the stride whose columns change the least between rows
+    size_t count = std::min<size_t>(size / elementSize, 4096);
+    double best = 0.0;
+    for (int candidate = 1; candidate <= 16; ++candidate)
+    {
+        if (count < size_t(candidate) * 4)
+            break;
+        double delta = 0.0;
+        for (size_t i = candidate; i < count; ++i)
+        {
+            double a = InspectorValue(mode, data + i * elementSize);
+            double b = InspectorValue(mode, data + (i - candidate) * elementSize);
+            if (std::isfinite(a) && std::isfinite(b))
+                delta += std::min(fabs(a - b), 1.0e6);
+        }
+        delta /= double(count - candidate);
+        if (candidate == 1 || delta < best * 0.9)
+        {
+            best = delta;
+            stride = candidate;
+        }
+    }
+}
+//------------------------------------------------------------------------------
+static void InspectorText(char const* data, size_t size)
+{
+    size_t count = size / sizeof(uint16_t);
+    size_t rows = (count + 31) / 32;
+
+    ImGuiListClipper clipper;
+    clipper.Begin(int(rows));
+    while (clipper.Step())
+    {
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+        {
+            std::string text;
+            for (size_t i = size_t(row) * 32; i < count && i < size_t(row + 1) * 32; ++i)
+            {
+                uint32_t c = 0;
+                memcpy(&c, data + i * sizeof(uint16_t), sizeof(uint16_t));
+                if (c >= 0xD800 && c < 0xDC00 && i + 1 < count)
+                {
+                    uint32_t low = 0;
+                    memcpy(&low, data + (i + 1) * sizeof(uint16_t), sizeof(uint16_t));
+                    if (low >= 0xDC00 && low < 0xE000)
+                    {
+                        c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                        i++;
+                    }
+                }
+                if (c < 0x20)
+                {
+                    text += '.';
+                }
+                else if (c < 0x80)
+                {
+                    text += char(c);
+                }
+                else if (c < 0x800)
+                {
+                    text += char(0xC0 | (c >> 6));
+                    text += char(0x80 | (c & 0x3F));
+                }
+                else if (c < 0x10000)
+                {
+                    text += char(0xE0 | (c >> 12));
+                    text += char(0x80 | ((c >> 6) & 0x3F));
+                    text += char(0x80 | (c & 0x3F));
+                }
+                else
+                {
+                    text += char(0xF0 | (c >> 18));
+                    text += char(0x80 | ((c >> 12) & 0x3F));
+                    text += char(0x80 | ((c >> 6) & 0x3F));
+                    text += char(0x80 | (c & 0x3F));
+                }
+            }
+            ImGui::Text("%08zX", row * 32 * sizeof(uint16_t));
+            ImGui::SameLine();
+            ImGui::TextUnformatted(text.c_str());
+        }
+    }
+}
+//------------------------------------------------------------------------------
+static void Inspector(int mode)
+{
+    static size_t version = SIZE_MAX;
+    static int cacheMode;
+    static int skip;
+    static int stride;
+    static std::vector<std::pair<double, double>> ranges;
+
+    char const* data = fileContent.data();
+    size_t size = fileContent.size();
+
+    // PB2 records carry a 15 bytes header
+    if (mode == 5)
+    {
+        if (fileContentType != 0x000E && fileContentType != 0x100E)
+        {
+            ImGui::TextUnformatted("Not a PB2 record");
+            return;
+        }
+        if (size < 15)
+            return;
+        uint16_t index;
+        uint32_t type;
+        memcpy(&index, data + 0, sizeof(uint16_t));
+        memcpy(&type, data + 2, sizeof(uint32_t));
+        ImGui::Text("Index:%d", index);
+        ImGui::Text("Type:%d%s", type & 0x7FF, (type & 0x800) ? " (Tab)" : "");
+        ImGui::Text("Size:%zd", size - 15);
+        for (size_t i = 15; i + sizeof(uint32_t) <= size && i < 15 + 16 * sizeof(uint32_t); i += sizeof(uint32_t))
+        {
+            ImGui::Text("%02zX : %-12g %-12d %08X", i - 15, InspectorValue(1, data + i), int(InspectorValue(2, data + i)), uint32_t(InspectorValue(2, data + i)));
+        }
+        return;
+    }
+
+    if (version != fileContentVersion || cacheMode != mode)
+    {
+        version = fileContentVersion;
+        cacheMode = mode;
+        ranges.clear();
+        if (mode != 4)
+        {
+            InspectorGuess(mode, data, size, skip, stride);
+        }
+    }
+    if (mode == 4)
+    {
+        if (ImGui::BeginChild("Inspector", ImVec2(0, ImGui::GetTextLineHeightWithSpacing() * 15)))
+        {
+            InspectorText(data, size);
+            ImGui::EndChild();
+        }
+        return;
+    }
+
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(96.0f);
+    if (ImGui::InputInt("SKIP", &skip))
+        ranges.clear();
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(96.0f);
+    if (ImGui::InputInt("STRIDE", &stride))
+        ranges.clear();
+    skip = std::clamp(skip, 0, int(std::min<size_t>(size, 0x7FFFFFFF)));
+    stride = std::clamp(stride, 1, 16);
+
+    size_t elementSize = InspectorSize(mode);
+    size_t count = (size - skip) / elementSize;
+    size_t rows = count / stride;
+    data += skip;
+
+    // Column ranges are computed once per selection and layout
+    if (ranges.empty())
+    {
+        ranges.assign(stride, { HUGE_VAL, -HUGE_VAL });
+        for (size_t i = 0; i < rows * stride; ++i)
+        {
+            double value = InspectorValue(mode, data + i * elementSize);
+            if (std::isfinite(value) == false)
+                continue;
+            auto& range = ranges[i % stride];
+            range.first = std::min(range.first, value);
+            range.second = std::max(range.second, value);
+        }
+    }
+
+    if (ImGui::BeginTable("Inspector", stride + 1, ImGuiTableFlags_ScrollX | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit, ImVec2(0, ImGui::GetTextLineHeightWithSpacing() * 15)))
+    {
+        ImGui::TableSetupScrollFreeze(1, 1);
+        ImGui::TableSetupColumn("Row");
+        for (int column = 0; column < stride; ++column)
+        {
+            char text[64];
+            snprintf(text, 64, "%d [%g, %g]", column, ranges[column].first, ranges[column].second);
+            ImGui::TableSetupColumn(text);
+        }
+        ImGui::TableHeadersRow();
+
+        ImGuiListClipper clipper;
+        clipper.Begin(int(rows));
+        while (clipper.Step())
+        {
+            for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+            {
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                ImGui::Text("%d", row);
+                for (int column = 0; column < stride; ++column)
+                {
+                    ImGui::TableSetColumnIndex(column + 1);
+                    double value = InspectorValue(mode, data + (size_t(row) * stride + column) * elementSize);
+                    if (mode == 1)
+                        ImGui::Text("%g", value);
+                    else
+                        ImGui::Text("%.0f", value);
+                }
+            }
+        }
+        ImGui::EndTable();
+    }
+}
+//------------------------------------------------------------------------------
 void MaxReader::Initialize()
 {
 #if defined(_WIN32)
@@ -256,8 +1028,13 @@ void MaxReader::Initialize()
 //------------------------------------------------------------------------------
 void MaxReader::Shutdown()
 {
+    SearchStop();
+    DiffReset();
     delete fileDialog;
     delete root;
+    root = nullptr;
+    ChunkReset();
+    SearchReset();
 }
 //------------------------------------------------------------------------------
 bool MaxReader::Update(const UpdateData& updateData, bool& show)
@@ -283,19 +1060,44 @@ bool MaxReader::Update(const UpdateData& updateData, bool& show)
 #endif
             fileDialog->OpenDialog("MaxReader", "Choose File", "All Files(*.*){.*}", config);
         }
+        ImGui::SameLine();
+        if (ImGui::Button("GLB") && root)
+        {
+            std::string name = path.substr(0, path.rfind('.')) + ".glb";
+            if (miMAXExportGLB(*root, name.c_str(), MaxReaderLog))
+            {
+                MaxReaderLog("Export : %s", name.c_str());
+            }
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Diff") && root)
+        {
+            IGFD::FileDialogConfig config = { path };
+#if defined(_WIN32)
+            if (config.path.size() && config.path.back() != '\\')
+                config.path.resize(config.path.rfind('\\') + 1);
+#else
+            if (config.path.size() && config.path.back() != '/')
+                config.path.resize(config.path.rfind('/') + 1);
+#endif
+            fileDialog->OpenDialog("MaxReaderDiff", "Choose File", "All Files(*.*){.*}", config);
+        }
+
+        auto& tabIndex = chunkTab;
+        auto tabFlags = [](int index) { return chunkTabSelect == index ? ImGuiTabItemFlags_SetSelected : 0; };
 
-        static int tabIndex;
-        static std::vector<char> fileContent;
-        static size_t fileContentIndex;
+        SearchFinder();
+        DiffFinder();
 
         ImGui::BeginTabBar("Type");
-        if (ImGui::BeginTabItem("ClassData",      nullptr, 0)) { tabIndex = 0; ImGui::EndTabItem(); }
-        if (ImGui::BeginTabItem("ClassDirectory", nullptr, 0)) { tabIndex = 1; ImGui::EndTabItem(); }
-        if (ImGui::BeginTabItem("Config",         nullptr, 0)) { tabIndex = 2; ImGui::EndTabItem(); }
-        if (ImGui::BeginTabItem("DllDirectory",   nullptr, 0)) { tabIndex = 3; ImGui::EndTabItem(); }
-        if (ImGui::BeginTabItem("Scene",          nullptr, 0)) { tabIndex = 4; ImGui::EndTabItem(); }
-        if (ImGui::BeginTabItem("VideoPostQueue", nullptr, 0)) { tabIndex = 5; ImGui::EndTabItem(); }
+        if (ImGui::BeginTabItem("ClassData",      nullptr, tabFlags(0))) { tabIndex = 0; ImGui::EndTabItem(); }
+        if (ImGui::BeginTabItem("ClassDirectory", nullptr, tabFlags(1))) { tabIndex = 1; ImGui::EndTabItem(); }
+        if (ImGui::BeginTabItem("Config",         nullptr, tabFlags(2))) { tabIndex = 2; ImGui::EndTabItem(); }
+        if (ImGui::BeginTabItem("DllDirectory",   nullptr, tabFlags(3))) { tabIndex = 3; ImGui::EndTabItem(); }
+        if (ImGui::BeginTabItem("Scene",          nullptr, tabFlags(4))) { tabIndex = 4; ImGui::EndTabItem(); }
+        if (ImGui::BeginTabItem("VideoPostQueue", nullptr, tabFlags(5))) { tabIndex = 5; ImGui::EndTabItem(); }
         ImGui::EndTabBar();
+        chunkTabSelect = -1;
 
         ImGui::Columns(2);
         if (ImGui::BeginChild("ChunkFinder", ImVec2(0, ImGui::GetTextLineHeightWithSpacing() * 16)))
@@ -314,59 +1116,28 @@ bool MaxReader::Update(const UpdateData& updateData, bool& show)
                 }
                 if (chunk)
                 {
-                    updated |= ChunkFinder(*chunk, [](uint16_t type, std::vector<char> const& data)
+                    updated |= ChunkFinder(*chunk, [](uint16_t type, std::pmr::vector<char> const& data)
                     {
-                        fileContent = data;
+                        fileContent.assign(data.begin(), data.end());
                         fileContentIndex = 0;
+                        fileContentType = type;
+                        fileContentVersion++;
                     });
                 }
             }
             ImGui::EndChild();
         }
         ImGui::NextColumn();
-        for (size_t i = fileContentIndex, size = fileContent.size(); i < fileContentIndex + 256; i += 16)
+        static int inspectorMode;
+        ImGui::SetNextItemWidth(160.0f);
+        ImGui::Combo("##InspectorMode", &inspectorMode, "Hex\0Float32\0Int32\0UInt16\0UTF-16\0PB2\0");
+        if (inspectorMode != 0)
         {
-            size_t count;
-            if (i >= size)
-                count = 0;
-            else if ((i + 16) > size)
-                count = fileContent.size() % 16;
-            else
-                count = 16;
-
-            uint8_t pitch[16] = {};
-            memcpy(pitch, fileContent.data() + i, count);
-
-            char line[64];
-            for (size_t i = 0; i < 16; ++i)
-            {
-                snprintf(line, 64, "%s%s", line, i < count && i && i % 4 == 0 ? "-" : " ");
-                snprintf(line + i * 3, 64 - i * 3, i < count ? "%02x" : "  ", pitch[i]);
-            }
-            ImGui::TextUnformatted(line);
-            ImGui::SameLine();
-            for (uint8_t& c : pitch)
-            {
-                if (c == 0 || c == '\t' || c == '\n')
-                    c = ' ';
-            }
-            ImGui::Text("\t%c%c%c%c%c%c%c%c%c%c%c%c%c%c%c%c",
-                        pitch[0], pitch[1], pitch[2], pitch[3],
-                        pitch[4], pitch[5], pitch[6], pitch[7],
-                        pitch[8], pitch[9], pitch[10], pitch[11],
-                        pitch[12], pitch[13], pitch[14], pitch[15]);
-        }
-        if (ImGui::IsWindowHovered())
-        {
-            float wheel = ImGui::GetIO().MouseWheel;
-            if (wheel > 0.0f && fileContentIndex - 16 < fileContentIndex)
-                fileContentIndex -= 16;
-            if (wheel < 0.0f && fileContentIndex + 16 < fileContent.size())
-                fileContentIndex += 16;
-            if (ImGui::IsKeyReleased(ImGuiKey_PageUp) && fileContentIndex - 256 < fileContentIndex)
-                fileContentIndex -= 256;
-            if (ImGui::IsKeyReleased(ImGuiKey_PageDown) && fileContentIndex + 256 < fileContent.size())
-                fileContentIndex += 256;
+            Inspector(inspectorMode);
+        }
+        else
+        {
+            HexView();
         }
         ImGui::Columns(1);
 
@@ -403,12 +1174,32 @@ bool MaxReader::Update(const UpdateData& updateData, bool& show)
     {
         if (fileDialog->IsOk())
         {
+            SearchStop();
+            DiffReset();
             delete root;
             root = nullptr;
             info.clear();
+            ChunkReset();
 
             path = fileDialog->GetFilePathName();
             root = miMAXOpenFile(path.c_str(), MaxReaderLog);
+            ChunkReset();
+            SearchReset();
+        }
+        fileDialog->Close();
+    }
+
+    if (fileDialog->Display("MaxReaderDiff", 0, ImVec2(512, 384)))
+    {
+        if (fileDialog->IsOk() && root)
+        {
+            DiffReset();
+            diffRoot = miMAXOpenFile(fileDialog->GetFilePathName().c_str(), MaxReaderLog);
+            if (diffRoot)
+            {
+                miMAXDiffFile(*root, *diffRoot, diffs);
+                MaxReaderLog("Diff : %zd", diffs.size());
+            }
         }
         fileDialog->Close();
     }